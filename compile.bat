@@ -9,9 +9,9 @@ windres resources/resources.rc %resource_path%
 cd include
 
 :: Windows api interface
-set api_src=api/console.cpp api/core.cpp api/input.cpp api/keypress_handler.cpp api/resource_locator.cpp api/timer.cpp
+set api_src=api/console.cpp api/core.cpp api/input.cpp api/keypress_handler.cpp api/resource_locator.cpp api/timer.cpp api/presenter_types/presenter_console.cpp api/presenter_types/presenter_ansi.cpp api/mapped_file.cpp
 set audio_src=audio/core.cpp audio/audiochannel.cpp audio/audiointerface.cpp audio/source_types/audiosource_single.cpp audio/source_types/audiosource_circular.cpp audio/source_types/audiosource_looping.cpp audio/source_types/iaudiosource.cpp
-set render_src=render/core.cpp render/tinyphysicsengine.cpp
+set render_src=render/core.cpp render/mesh_simplify.cpp render/obj_loader.cpp render/tinyphysicsengine.cpp
 set ui_src=ui/core.cpp ui/strided_memcpy.cpp
 
 set compile_opts= -std=c++20 -O3 -ffast-math -DCOMPILER_DEBUG=0 -I.
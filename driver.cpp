@@ -86,6 +86,7 @@ int main() {
     auto audio_interface = audio::XAudioInterface::create();
     audio_init(audio_interface);
     api::on_error = [&] {
+        framebuffer.set_async_present(api::off);
         enable_ansi();
         std::cout << "\x1b[0;30;41m";
         window.set_keystate({ 0,0 });
@@ -113,6 +114,7 @@ int test_engine(ARGUMENTS) {
     const api::KeypressHandler SPRINTING = khf('R', api::eContinuous);
     const api::KeypressHandler FREECAM = khf(VK_TAB, api::eSingle);
     const api::KeypressHandler DEBUG = khf('I', api::eSingle);
+    const api::KeypressHandler SUBCELLS = khf('B', api::eSingle);
 
     auto bufcoords = window.get_buffer_coords();
     auto screen_coords = framebuffer.get_screen_coords(window.get_screen_coords());
@@ -284,6 +286,7 @@ int test_engine(ARGUMENTS) {
         helper_set3DColor(0); {
             TPE_Unit scale = 600;
             helper_drawModel(&levelModel, TPE_vec3(0,0,0), TPE_vec3(scale,scale,scale), TPE_vec3(0,0,0));
+            helper_drawOccluders();
         }
 
         // White color
@@ -299,6 +302,9 @@ int test_engine(ARGUMENTS) {
             helper_draw3DSphere(ball_body->joints[0].position,
                                 TPE_vec3(1000, 1000, 1000), ballRot);
         }
+
+        // Flush before the HUD is written on top
+        helper_drawScene();
     };
 
     auto poll_volume = [&] {
@@ -334,6 +340,14 @@ int test_engine(ARGUMENTS) {
         if(disp_fps) {
             framebuffer.write_line("FPS: %.1f, Music volume: %i%%    ", average_fps, (int)(music_volume * 100));
             framebuffer.write_line("NOW PLAYING: %s   ", current_song.c_str());
+
+            const auto& present_stats = framebuffer.get_present_stats();
+            framebuffer.write_line("OUTPUT: %zu bytes, %zu spans   ", present_stats.bytes, present_stats.spans);
+            framebuffer.write_line("PRESENT: %.2fms latency, %zu dropped   ", present_stats.latency_ms, present_stats.dropped);
+            framebuffer.write_line("RENDER SCALE: %i%%   ", (int)(helper_resolution.get_scale() * 100));
+            framebuffer.write_line("MODELS: %zu drawn, %zu culled, %zu occluded   ",
+                                   helper_context.drawn_count(), helper_context.culled_count(),
+                                   helper_context.occluded_count());
             buf_print(framebuffer, "POS", player_body.foot_position());
 
             auto look_vec = TPE_vec3(playerDirectionVec.x, headAngle, playerDirectionVec.z);
@@ -429,6 +443,7 @@ int test_engine(ARGUMENTS) {
         updateDirection();
 
         if(DEBUG()) debug_draw = !debug_draw;
+        if(SUBCELLS()) helper_subcellMode = (helper_subcellMode + 1) % 3;
         tick_draw();
 
         poll_volume();
@@ -438,11 +453,13 @@ int test_engine(ARGUMENTS) {
 
         if(ESCAPE()) helper_running = false;
 
+        helper_frameTime(time.elapsed_ms());
         poll_sleep();
     }
 
     framebuffer.get_active_buffer()->set_buffer_data(255);
     framebuffer.post_buffer();
+    framebuffer.set_async_present(api::off);
     window.set_keystate(buffer_middle);
     std::printf("Bye bye!");
 
@@ -603,8 +620,9 @@ int test_ui(ARGUMENTS) {
 }
 
 static void render_init(api::Framebuffer<ModeASCII>& fb, api::Coords bc) {
-    fb.set_details(bc, 3);
+    fb.set_details(bc, api::DefaultFramebuffer::async_buffer_count);
     fb.initialize_buffers();
+    fb.set_async_present(api::on);
     render::initialize_buffer(fb);
     render::initialize_screen(bc * api::Coords{ 1, 2 });
 }
@@ -3,7 +3,14 @@
 #include <algorithm>
 #include <thread>
 #include <locale>
-#include <strsafe.h>
+
+#if API_WIN32
+#  include <strsafe.h>
+#else
+#  include <cerrno>
+#  include <cstring>
+#  include <unistd.h>
+#endif
 
 namespace api {
     Coords::operator POINT() CNOEXCEPT {
@@ -119,7 +126,12 @@ namespace api {
         std::cout << "Press [esc/return] to continue..." << std::endl;
         using namespace std::chrono_literals;
         std::this_thread::sleep_for(500ms);
+    #if API_WIN32
         while(not (WIN_PRESSED(VK_ESCAPE) or WIN_PRESSED(VK_RETURN))) {}
+    #else
+        char c = 0;
+        while(read(STDIN_FILENO, &c, 1) == 1 and not (c == '\x1b' or c == '\r' or c == '\n')) {}
+    #endif
         std::exit(code);
     }
 
@@ -145,6 +157,7 @@ namespace api {
     }
 
 
+#if API_WIN32
     static std::string narrow(LPCSTR buf, MAYBE_UNUSED std::size_t out_size) {
         return { buf };
     }
@@ -185,4 +198,14 @@ namespace api {
         std::cout << throw_buf << std::endl;
         if(exit_on_error) waiting_exit(-2);
     }
+#else
+    void handle_last_error(const char* filename, int line, LPCTSTR function, bool exit_on_error) {
+        const int err_code = errno;
+        if(on_error) on_error();
+        DEBUG_ONLY( std::cout << filename << ":" << line << '\n'; )
+        std::cout << "OS error: \"" << function << "\" failed with error "
+                  << err_code << "; " << std::strerror(err_code) << std::endl;
+        if(exit_on_error) waiting_exit(-2);
+    }
+#endif
 }
@@ -82,6 +82,7 @@ namespace api {
 
     enum toggle : bool { off, on };
 
+#if API_WIN32
     inline Coords device_resolution() noexcept {
         HDC dc_handle = GetDC(nullptr);
         return {
@@ -89,6 +90,7 @@ namespace api {
                 .y = GetDeviceCaps(dc_handle, VERTRES),
         };
     }
+#endif
 
     inline std::function<void()> on_error;
     void assertion_impl(const char* filename, const char* func, int line, bool condition, const std::string& err);
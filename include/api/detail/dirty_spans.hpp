@@ -0,0 +1,114 @@
+#ifndef PROJECT3_TEST_DIRTY_SPANS_HPP
+#define PROJECT3_TEST_DIRTY_SPANS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <vector>
+#include <config.hpp>
+
+namespace api {
+    /**
+     * A run of changed cells starting at (x, y). A span may be longer than
+     * a row, in which case it wraps onto the following rows (full redraws).
+     */
+    struct DirtySpan {
+        int x, y;
+        int length;
+    };
+
+    /**
+     * Output counters for the last presented frame, plus running frame counts.
+     */
+    struct PresentStats {
+        std::size_t bytes = 0;      /// Bytes handed to the output device
+        std::size_t spans = 0;      /// Separate writes/cursor moves issued
+        std::size_t cells = 0;      /// Cells covered by the emitted spans
+        double latency_ms = 0.0;    /// Time from posting the frame to the end of its write
+
+        std::size_t presented = 0;  /// Frames written so far
+        std::size_t dropped = 0;    /// Frames replaced by a newer post before they were written
+    };
+
+    /**
+     * Keeps a copy of the last presented frame and computes the runs
+     * of cells that changed since then, row by row.
+     */
+    template <typename T>
+    struct DirtySpanTracker {
+        static constexpr int default_merge_gap = 8;
+
+        DirtySpanTracker() = default;
+        explicit DirtySpanTracker(int merge_gap) : _merge_gap(merge_gap) {}
+
+        /**
+         * Computes the changed spans of `frame` and records it as the new previous frame.
+         * Unchanged gaps shorter than the merge gap are folded into the surrounding span,
+         * since rewriting a few cells is cheaper than starting a new write.
+         */
+        std::span<const DirtySpan> diff(std::span<const T> frame, int width) NOEXCEPT {
+            _spans.clear();
+            if(frame.empty() or width <= 0) return {};
+
+            if(not _valid or _previous.size() != frame.size() or _width != width) {
+                _previous.assign(frame.begin(), frame.end());
+                _width = width;
+                _valid = true;
+                _spans.push_back({ 0, 0, static_cast<int>(frame.size()) });
+                return _spans;
+            }
+
+            const int height = static_cast<int>(frame.size()) / width;
+            for(int y = 0; y < height; ++y) {
+                const T* curr = frame.data() + (y * width);
+                T* prev = _previous.data() + (y * width);
+                if(std::memcmp(curr, prev, width * sizeof(T)) == 0) continue;
+
+                _diff_row(curr, prev, y, width);
+                std::memcpy(prev, curr, width * sizeof(T));
+            }
+
+            return _spans;
+        }
+
+        /// Forces the next diff to emit the whole frame.
+        void invalidate() NOEXCEPT { _valid = false; }
+        void set_merge_gap(int gap) NOEXCEPT { _merge_gap = std::max(gap, 0); }
+
+        NODISCARD std::span<const DirtySpan> spans() CNOEXCEPT { return _spans; }
+        NODISCARD int get_merge_gap() CNOEXCEPT { return _merge_gap; }
+
+    private:
+        void _diff_row(const T* curr, const T* prev, int y, int width) NOEXCEPT {
+            int x = 0;
+            while(x < width) {
+                while(x < width and curr[x] == prev[x]) ++x;
+                if(x == width) break;
+
+                const int start = x;
+                int end = ++x;
+                int gap = 0;
+
+                for(; x < width; ++x) {
+                    if(curr[x] != prev[x]) {
+                        end = x + 1;
+                        gap = 0;
+                    }
+                    else if(++gap > _merge_gap) break;
+                }
+
+                _spans.push_back({ start, y, end - start });
+            }
+        }
+
+    private:
+        std::vector<T> _previous;
+        std::vector<DirtySpan> _spans;
+        int _merge_gap = default_merge_gap;
+        int _width = 0;
+        bool _valid = false;
+    };
+}
+
+#endif //PROJECT3_TEST_DIRTY_SPANS_HPP
@@ -0,0 +1,134 @@
+#ifndef PROJECT3_TEST_WORKER_POOL_HPP
+#define PROJECT3_TEST_WORKER_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <config.hpp>
+
+namespace api {
+    /**
+     * Fixed set of threads for fork-join style loops.
+     * The calling thread takes part in every loop, so a pool of
+     * size n runs n + 1 iterations at a time.
+     */
+    struct WorkerPool {
+        explicit WorkerPool(unsigned count = default_worker_count()) {
+            _workers.reserve(count);
+            for(unsigned i = 0; i < count; ++i) {
+                _workers.emplace_back([this] { _worker_loop(); });
+            }
+        }
+
+        WorkerPool(const WorkerPool&) = delete;
+
+        ~WorkerPool() {
+            {
+                std::lock_guard lock { _lock };
+                _stopping = true;
+            }
+            _job_ready.notify_all();
+            for(std::thread& worker : _workers) worker.join();
+        }
+
+        /**
+         * Calls fn(i) for every i in [0, count) and returns once all calls are done.
+         * Iterations are handed out one at a time, so uneven work balances itself.
+         */
+        template <typename F>
+        void parallel_for(int count, F&& fn) NOEXCEPT {
+            if(count <= 0) return;
+            if(_workers.empty() or count == 1) {
+                for(int i = 0; i < count; ++i) fn(i);
+                return;
+            }
+
+            {
+                std::lock_guard lock { _lock };
+                _job = { &fn, [](void* ctx, int i) { (*static_cast<F*>(ctx))(i); }, count };
+                _next.store(0, std::memory_order_relaxed);
+                _remaining.store(count, std::memory_order_relaxed);
+                ++_generation;
+            }
+            _job_ready.notify_all();
+
+            _run_job(_job);
+
+            /// Workers still holding this job must let go before `fn` goes out of scope
+            std::unique_lock lock { _lock };
+            _job_done.wait(lock, [this] {
+                return _remaining.load(std::memory_order_acquire) == 0 and _active == 0;
+            });
+            _job = {};
+        }
+
+        NODISCARD unsigned size() CNOEXCEPT {
+            return static_cast<unsigned>(_workers.size());
+        }
+
+        /// One worker per hardware thread, minus the caller.
+        static unsigned default_worker_count() NOEXCEPT {
+            const unsigned hw = std::thread::hardware_concurrency();
+            return (hw > 1) ? (hw - 1) : 0;
+        }
+
+    private:
+        struct Job {
+            void* ctx = nullptr;
+            void(*call)(void*, int) = nullptr;
+            int count = 0;
+        };
+
+        void _run_job(Job job) NOEXCEPT {
+            if(not job.call) return;
+
+            int i;
+            int done = 0;
+            while((i = _next.fetch_add(1, std::memory_order_relaxed)) < job.count) {
+                job.call(job.ctx, i);
+                ++done;
+            }
+
+            if(done) _remaining.fetch_sub(done, std::memory_order_acq_rel);
+        }
+
+        void _worker_loop() NOEXCEPT {
+            std::size_t seen = 0;
+            while(true) {
+                Job job;
+                {
+                    std::unique_lock lock { _lock };
+                    _job_ready.wait(lock, [&] { return _stopping or _generation != seen; });
+                    if(_stopping) return;
+                    seen = _generation;
+                    job = _job;
+                    ++_active;
+                }
+
+                _run_job(job);
+
+                std::lock_guard lock { _lock };
+                if(--_active == 0) _job_done.notify_all();
+            }
+        }
+
+    private:
+        std::vector<std::thread> _workers;
+        std::mutex _lock;
+        std::condition_variable _job_ready;
+        std::condition_variable _job_done;
+
+        Job _job;
+        int _active = 0;                    // Workers currently holding _job
+        std::size_t _generation = 0;
+        std::atomic<int> _next = 0;
+        std::atomic<int> _remaining = 0;
+        bool _stopping = false;
+    };
+}
+
+#endif //PROJECT3_TEST_WORKER_POOL_HPP
@@ -2,12 +2,19 @@
 #define PROJECT3_TEST_FRAMEBUFFER_HPP
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
 #include <memory>
+#include <mutex>
 #include <span>
+#include <thread>
 #include <vector>
 
 #include <api/core.hpp>
+#include <api/detail/dirty_spans.hpp>
+#include <api/presenter.hpp>
 
 #define API_STRIDE(cd, rs) (cd.x + (cd.y * rs.x))
 #define API_WRAP(value, max) do { value = (value >= max) ? 0 : (value); } while(0)
@@ -124,13 +131,28 @@ namespace api {
             eDoResize,
         };
 
+        enum class PresentMode {
+            eFull,      /// Rewrite the whole buffer every frame
+            eDiff,      /// Only write the spans that changed since the last post
+        };
+
         using _ibuffer_t = Buffer<T>;
         using _wibuffer_t = WrappedBuffer<T>;
         using _ibuffer_underlying_t = typename _ibuffer_t::_buffer_t;
+        using _clock_t = std::chrono::steady_clock;
+
+        /// Async presentation needs exactly one buffer each for drawing, handoff and output
+        static constexpr int async_buffer_count = 3;
 
         Framebuffer(int count = 0) : _console_res({ 0,0 }), _buffer_count(count) {}
         Framebuffer(Coords coords, int count = 0) : _console_res(coords), _buffer_count(count) {}
 
+        Framebuffer(const Framebuffer&) = delete;
+
+        ~Framebuffer() {
+            _stop_present_thread();
+        }
+
         void set_details(Coords coords, int count) NOEXCEPT {
             if(not _running) {
                 _console_res = coords;
@@ -144,7 +166,11 @@ namespace api {
             if(_console_res.area() && _buffer_count) {
                 _buffers = std::vector<_ibuffer_t>(_buffer_count, { _console_res });
                 _drawing_buffer = _buffers.size() - 1;
-                _cout_handle = GetStdHandle(STD_OUTPUT_HANDLE);
+                if(not _presenter) _presenter = make_presenter();
+                if(not _presenter->open()) UNLIKELY {
+                    debug_printf("initialize_buffers(): Presenter could not be opened.");
+                    return false;
+                }
                 _running = true;
                 return true;
             }
@@ -158,7 +184,6 @@ namespace api {
             if(_running && coords.area()) LIKELY {
                 _console_res = coords;
                 _buffer_state = State::eDoResize;
-                _cout_handle = GetStdHandle(STD_OUTPUT_HANDLE);
             }
             else UNLIKELY {
                 debug_printf("update_buffers(Coords coords): Framebuffer passed invalid arguments.");
@@ -188,22 +213,43 @@ namespace api {
             return get_active_buffer()->raw_data();
         }
 
+        /**
+         * Presents the active buffer. In async mode the buffer is only published
+         * to the present thread, and the active buffer is replaced by a free one.
+         */
         State post_buffer() NOEXCEPT {
-            BEG_FRAME("buffer writing")
-            auto buffer_data = _buffers[_selected_buffer].get_buffer_data();
-            DWORD written_characters;
-            WriteConsoleOutputCharacterA(_cout_handle, buffer_data.data(), buffer_data.size(), { 0,0 }, &written_characters);
-            END_FRAME("buffer writing")
+            if(_async) {
+                _publish_buffer();
+            }
+            else {
+                BEG_FRAME("buffer writing")
+                _present_buffer(_selected_buffer, _clock_t::now());
+                END_FRAME("buffer writing")
+            }
+
+            if(Coords new_res; _presenter->poll_resize(new_res)) UNLIKELY {
+                update_buffers(new_res);
+            }
 
             if(_buffer_state == State::eDoResize) UNLIKELY {
-                return _update_buffers();
+                const bool was_async = _async;
+                _stop_present_thread();
+                State state = _update_buffers();
+                if(was_async) _start_present_thread();
+                return state;
             }
 
             _written_lines = 0;
             return _buffer_state;
         }
 
+        /**
+         * Moves on to the next buffer. In async mode post_buffer() has already
+         * handed out a free buffer, so this just returns the active one.
+         */
         _wibuffer_t swap_buffers() NOEXCEPT {
+            if(_async) return _buffers[_selected_buffer];
+
             ++_selected_buffer, ++_drawing_buffer;
             API_WRAP(_selected_buffer, _buffers.size());
             API_WRAP(_drawing_buffer, _buffers.size());
@@ -211,9 +257,62 @@ namespace api {
         }
 
         void sync_buffers() NOEXCEPT {
+            debug_assert(not _async, "Posted buffers can't be written in async mode.");
             _buffers[_drawing_buffer] = _buffers[_selected_buffer];
         }
 
+        /**
+         * Forces the next post to rewrite the whole screen.
+         * Use this after something other than the framebuffer has written to the console.
+         */
+        void invalidate() NOEXCEPT {
+            _invalidate_pending.store(true, std::memory_order_relaxed);
+        }
+
+        void set_present_mode(PresentMode mode) NOEXCEPT {
+            _present_mode.store(mode, std::memory_order_relaxed);
+        }
+
+        /**
+         * Moves output onto a dedicated thread. Posted buffers are handed over through
+         * an atomic triple buffer index, so posting never waits on the device, and
+         * a frame that is replaced before the thread gets to it is dropped.
+         * Turning it off writes out the last pending frame before returning.
+         */
+        void set_async_present(toggle state) NOEXCEPT {
+            if(state == on) {
+                if(_async) return;
+                if(not _running or _buffers.size() != async_buffer_count) UNLIKELY {
+                    debug_printf("set_async_present(): Async presentation needs %i initialized buffers.", async_buffer_count);
+                    return;
+                }
+
+                _ready_buffer.store((_selected_buffer + 1) % async_buffer_count);
+                _presenting_buffer = (_selected_buffer + 2) % async_buffer_count;
+                _start_present_thread();
+            }
+            else {
+                _stop_present_thread();
+            }
+        }
+
+        /**
+         * Replaces the output device. If the framebuffer is already running
+         * the old presenter is closed and the next post rewrites the whole screen.
+         */
+        void set_presenter(std::unique_ptr<IPresenter> presenter) NOEXCEPT {
+            debug_assert(presenter, "Presenter cannot be null.");
+            const bool was_async = _async;
+            _stop_present_thread();
+            if(_running) {
+                _presenter->close();
+                presenter->open();
+                _tracker.invalidate();
+            }
+            _presenter = std::move(presenter);
+            if(was_async) _start_present_thread();
+        }
+
         int write_line(const std::string& format, auto...vv) NOEXCEPT {
             if constexpr(std::is_same_v<T, char>) {
                 if(_written_lines >= get_active_buffer()->get_y()) _written_lines = 0;
@@ -244,6 +343,26 @@ namespace api {
             return _buffer_count;
         }
 
+        NODISCARD IPresenter* get_presenter() CNOEXCEPT {
+            return _presenter.get();
+        }
+
+        NODISCARD PresentMode get_present_mode() CNOEXCEPT {
+            return _present_mode.load(std::memory_order_relaxed);
+        }
+
+        NODISCARD bool is_async_present() CNOEXCEPT {
+            return _async;
+        }
+
+        /// Output counters of the last presented frame, plus running frame counts.
+        NODISCARD PresentStats get_present_stats() CNOEXCEPT {
+            std::lock_guard lock { _stats_lock };
+            PresentStats stats = _present_stats;
+            stats.dropped = _dropped_frames.load(std::memory_order_relaxed);
+            return stats;
+        }
+
         NODISCARD dVec2 get_screen_coords(api::Coords screen_coords) CNOEXCEPT {
             return api::dVec2(get_coords()) / api::dVec2(screen_coords + 1);
         }
@@ -260,11 +379,83 @@ namespace api {
             return ret;
         }
 
+        /**
+         * Writes out buffer `index` and records its stats.
+         * Runs on the present thread in async mode, which then owns the tracker.
+         */
+        void _present_buffer(int index, _clock_t::time_point posted_at) NOEXCEPT {
+            auto& posted = _buffers[index];
+            auto buffer_data = posted.get_buffer_data();
+            if(_invalidate_pending.exchange(false, std::memory_order_relaxed)
+                or get_present_mode() == PresentMode::eFull) _tracker.invalidate();
+
+            PresentStats stats = {};
+            auto spans = _tracker.diff(buffer_data, posted.get_x());
+            _presenter->present(buffer_data, posted.get_coords(), spans, stats);
+
+            const std::chrono::duration<double, std::milli> latency = _clock_t::now() - posted_at;
+            std::lock_guard lock { _stats_lock };
+            stats.presented = _present_stats.presented + 1;
+            stats.latency_ms = latency.count();
+            _present_stats = stats;
+        }
+
+        /// Swaps the active buffer into the ready slot and takes back whatever was there.
+        void _publish_buffer() NOEXCEPT {
+            _posted_at[_selected_buffer] = _clock_t::now();
+            _drawing_buffer = _selected_buffer;
+
+            const int previous = _ready_buffer.exchange(_selected_buffer | _fresh_bit, std::memory_order_acq_rel);
+            if(previous & _fresh_bit) _dropped_frames.fetch_add(1, std::memory_order_relaxed);
+            _selected_buffer = previous & _index_mask;
+            _ready_buffer.notify_one();
+        }
+
+        void _present_loop() NOEXCEPT {
+            int ready = _ready_buffer.load(std::memory_order_acquire);
+            while(true) {
+                if(not (ready & _fresh_bit)) {
+                    if(ready & _stop_bit) break;
+                    _ready_buffer.wait(ready, std::memory_order_acquire);
+                    ready = _ready_buffer.load(std::memory_order_acquire);
+                    continue;
+                }
+
+                /// Only this thread clears the fresh bit, so the CAS can only fail on a newer publish
+                while(not _ready_buffer.compare_exchange_weak(ready, (ready & _stop_bit) | _presenting_buffer,
+                    std::memory_order_acq_rel, std::memory_order_acquire)) {}
+
+                _presenting_buffer = ready & _index_mask;
+                BEG_FRAME("buffer writing")
+                _present_buffer(_presenting_buffer, _posted_at[_presenting_buffer]);
+                END_FRAME("buffer writing")
+                ready = _ready_buffer.load(std::memory_order_acquire);
+            }
+        }
+
+        void _start_present_thread() NOEXCEPT {
+            _async = true;
+            _present_thread = std::thread([this] { _present_loop(); });
+        }
+
+        void _stop_present_thread() NOEXCEPT {
+            if(not _async) return;
+            if(std::this_thread::get_id() == _present_thread.get_id()) UNLIKELY { return; }
+
+            _ready_buffer.fetch_or(_stop_bit, std::memory_order_acq_rel);
+            _ready_buffer.notify_one();
+            _present_thread.join();
+            _ready_buffer.fetch_and(~_stop_bit, std::memory_order_acq_rel);
+            _async = false;
+        }
+
         State _update_buffers() NOEXCEPT {
             for(_ibuffer_t& buf : _buffers) {
                 buf.resize_buffer(_console_res);
             }
 
+            _tracker.invalidate();
+            _presenter->resize(_console_res);
             _buffer_state = State::eNormal;
             return State::eDoResize;
         }
@@ -273,7 +464,7 @@ namespace api {
         std::vector<_ibuffer_t> _buffers;
         Coords _console_res;
         int _buffer_count = 0;
-        HANDLE _cout_handle;
+        std::unique_ptr<IPresenter> _presenter;
 
         int _selected_buffer = 0;
         int _drawing_buffer = 0;
@@ -281,6 +472,24 @@ namespace api {
         bool _running = false;
         State _buffer_state = State::eNormal;
         std::size_t _written_lines = 0;
+
+        DirtySpanTracker<T> _tracker;
+        std::atomic<PresentMode> _present_mode = PresentMode::eDiff;
+        std::atomic<bool> _invalidate_pending = false;
+
+        mutable std::mutex _stats_lock;
+        PresentStats _present_stats;
+
+        static constexpr int _index_mask = 0b0011;
+        static constexpr int _fresh_bit = 0b0100;      // Ready slot holds a frame that hasn't been presented
+        static constexpr int _stop_bit = 0b1000;
+
+        bool _async = false;
+        std::thread _present_thread;
+        std::atomic<int> _ready_buffer = 0;             // Index of the handoff slot + flags
+        int _presenting_buffer = 0;                     // Owned by the present thread
+        std::atomic<std::size_t> _dropped_frames = 0;
+        std::array<_clock_t::time_point, async_buffer_count> _posted_at {};
     };
 
     template <typename T = ModeASCII>
@@ -0,0 +1,101 @@
+#include "mapped_file.hpp"
+#include <utility>
+
+#if API_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace api {
+    MappedFile::MappedFile(MappedFile&& rhs) NOEXCEPT {
+        _swap(rhs);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& rhs) NOEXCEPT {
+        if(this != &rhs) {
+            close();
+            _swap(rhs);
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#if API_WIN32
+    bool MappedFile::open(const fs::path& filepath) NOEXCEPT {
+        close();
+        _file = CreateFileW(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(_file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        if(not GetFileSizeEx(_file, &size) or size.QuadPart == 0) {
+            close();
+            return false;
+        }
+
+        _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(_mapping) _data = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+        if(not _data) {
+            close();
+            return false;
+        }
+
+        _size = static_cast<std::size_t>(size.QuadPart);
+        return true;
+    }
+
+    void MappedFile::close() NOEXCEPT {
+        if(_data) UnmapViewOfFile(_data);
+        if(_mapping) CloseHandle(_mapping);
+        if(_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+        _data = nullptr;
+        _size = 0;
+        _mapping = nullptr;
+        _file = INVALID_HANDLE_VALUE;
+    }
+
+    void MappedFile::_swap(MappedFile& rhs) NOEXCEPT {
+        std::swap(_data, rhs._data);
+        std::swap(_size, rhs._size);
+        std::swap(_file, rhs._file);
+        std::swap(_mapping, rhs._mapping);
+    }
+#else
+    bool MappedFile::open(const fs::path& filepath) NOEXCEPT {
+        close();
+        const int fd = ::open(filepath.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+
+        struct stat info {};
+        if(fstat(fd, &info) != 0 or info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+
+        /// The mapping keeps its own reference to the file
+        void* data = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(data == MAP_FAILED) return false;
+
+        _data = data;
+        _size = static_cast<std::size_t>(info.st_size);
+        return true;
+    }
+
+    void MappedFile::close() NOEXCEPT {
+        if(_data) munmap(const_cast<void*>(_data), _size);
+        _data = nullptr;
+        _size = 0;
+    }
+
+    void MappedFile::_swap(MappedFile& rhs) NOEXCEPT {
+        std::swap(_data, rhs._data);
+        std::swap(_size, rhs._size);
+    }
+#endif
+}
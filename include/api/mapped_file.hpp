@@ -0,0 +1,49 @@
+#ifndef PROJECT3_TEST_MAPPED_FILE_HPP
+#define PROJECT3_TEST_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <api/core.hpp>
+
+namespace fs = std::filesystem;
+
+namespace api {
+    /**
+     * Read only memory mapping of a whole file.
+     * The mapping is page aligned and stays valid until the object is closed or destroyed.
+     */
+    struct MappedFile {
+        MappedFile() = default;
+        explicit MappedFile(const fs::path& filepath) { open(filepath); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&& rhs) NOEXCEPT;
+        MappedFile& operator=(MappedFile&& rhs) NOEXCEPT;
+        ~MappedFile();
+
+        /// Returns false if the file doesn't exist or can't be mapped. Empty files can't be mapped.
+        bool open(const fs::path& filepath) NOEXCEPT;
+        void close() NOEXCEPT;
+
+        NODISCARD std::span<const std::byte> data() CNOEXCEPT {
+            return { static_cast<const std::byte*>(_data), _size };
+        }
+
+        NODISCARD std::size_t size() CNOEXCEPT { return _size; }
+        NODISCARD bool is_open() CNOEXCEPT { return _data != nullptr; }
+
+    private:
+        void _swap(MappedFile& rhs) NOEXCEPT;
+
+    private:
+        const void* _data = nullptr;
+        std::size_t _size = 0;
+    #if API_WIN32
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+    #endif
+    };
+}
+
+#endif //PROJECT3_TEST_MAPPED_FILE_HPP
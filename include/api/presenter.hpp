@@ -0,0 +1,19 @@
+#ifndef PROJECT3_TEST_PRESENTER_HPP
+#define PROJECT3_TEST_PRESENTER_HPP
+
+#include <memory>
+#include <api/presenter_types/presenter_console.hpp>
+#include <api/presenter_types/presenter_ansi.hpp>
+
+namespace api {
+    /// Creates the native presenter for the platform we're compiled for.
+    inline std::unique_ptr<IPresenter> make_presenter() {
+    #if API_WIN32
+        return std::make_unique<ConsolePresenter>();
+    #else
+        return std::make_unique<AnsiPresenter>();
+    #endif
+    }
+}
+
+#endif //PROJECT3_TEST_PRESENTER_HPP
@@ -0,0 +1,46 @@
+#ifndef PROJECT3_TEST_IPRESENTER_HPP
+#define PROJECT3_TEST_IPRESENTER_HPP
+
+#include <span>
+#include <api/core.hpp>
+#include <api/detail/dirty_spans.hpp>
+
+namespace api {
+    enum PresenterType {
+        eConsolePresenter,
+        eAnsiPresenter,
+    };
+
+    /**
+     * Output device behind Framebuffer::post_buffer.
+     * Receives the posted frame and the spans that changed since the last post.
+     */
+    struct IPresenter {
+        virtual ~IPresenter() = default;
+
+        virtual bool open() PURE;
+        virtual void close() PURE;
+
+        /**
+         * Writes the cells covered by `spans` to the device.
+         * `frame` is laid out `res.x` cells per row.
+         */
+        virtual void present(std::span<const char> frame, Coords res,
+                             std::span<const DirtySpan> spans, PresentStats& stats) PURE;
+
+        /// Called after the framebuffers have been resized.
+        virtual void resize(MAYBE_UNUSED Coords res) NOEXCEPT {}
+
+        /**
+         * Returns true if the device changed size since the last call,
+         * writing the new size in cells to `new_res`.
+         */
+        virtual bool poll_resize(MAYBE_UNUSED Coords& new_res) NOEXCEPT {
+            return false;
+        }
+
+        NODISCARD virtual PresenterType type() CNOEXCEPT PURE;
+    };
+}
+
+#endif //PROJECT3_TEST_IPRESENTER_HPP
@@ -0,0 +1,221 @@
+#include "presenter_ansi.hpp"
+
+#if API_POSIX
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define API_ANSI_LITERAL(out, str) (std::memcpy(out, str, sizeof(str) - 1), (out) + (sizeof(str) - 1))
+
+namespace api {
+    namespace {
+        struct Glyph {
+            char data[3];
+            std::uint8_t size;
+        };
+
+        /// Unicode values of code page 437 [128, 255], which the engine's glyphs are picked from.
+        /// 0xFF (nbsp) is used to blank the screen, so it's sent as a plain space.
+        constexpr char16_t cp437_upper[128] = {
+            0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7,
+            0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+            0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9,
+            0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+            0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA,
+            0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+            0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+            0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+            0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+            0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+            0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+            0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+            0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4,
+            0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+            0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248,
+            0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x0020,
+        };
+
+        constexpr Glyph encode_glyph(char16_t cp) {
+            if(cp < 0x80) return { { char(cp) }, 1 };
+            if(cp < 0x800) return { { char(0xC0 | (cp >> 6)), char(0x80 | (cp & 0x3F)) }, 2 };
+            return { { char(0xE0 | (cp >> 12)), char(0x80 | ((cp >> 6) & 0x3F)), char(0x80 | (cp & 0x3F)) }, 3 };
+        }
+
+        /// Control characters are written as spaces so they can't corrupt the terminal state.
+        constexpr std::array<Glyph, 256> glyph_table = [] {
+            std::array<Glyph, 256> table {};
+            for(int c = 0; c < 128; ++c) {
+                table[c] = encode_glyph((c < 0x20 or c == 0x7F) ? u' ' : char16_t(c));
+            }
+            for(int c = 128; c < 256; ++c) {
+                table[c] = encode_glyph(cp437_upper[c - 128]);
+            }
+            return table;
+        }();
+
+        /// Largest encoded cursor move, "\x1b[yyyyy;xxxxxH".
+        constexpr std::size_t max_cursor_move = 16;
+        constexpr std::size_t max_glyph_size = 3;
+
+        volatile std::sig_atomic_t resize_pending = 0;
+
+        void on_sigwinch(int) {
+            resize_pending = 1;
+        }
+    }
+
+    AnsiPresenter::~AnsiPresenter() {
+        this->close();
+    }
+
+    bool AnsiPresenter::open() {
+        if(_open) return true;
+
+        if(isatty(_in_fd) and tcgetattr(_in_fd, &_saved_termios) == 0) {
+            termios raw = _saved_termios;
+            raw.c_iflag &= ~(IXON | ICRNL | BRKINT | INPCK | ISTRIP);
+            raw.c_lflag &= ~(ECHO | ICANON | IEXTEN);
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            _raw = (tcsetattr(_in_fd, TCSAFLUSH, &raw) == 0);
+        }
+
+        struct sigaction action {};
+        action.sa_handler = on_sigwinch;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGWINCH, &action, &_saved_winch);
+        resize_pending = 0;
+
+        /// Alternate screen, hidden cursor
+        static constexpr char enter_seq[] = "\x1b[?1049h\x1b[?25l";
+        _flush(enter_seq, sizeof(enter_seq) - 1);
+
+        _cursor = Coords{ -1, -1 };
+        _clear_pending = true;
+        _open = true;
+        return true;
+    }
+
+    void AnsiPresenter::close() {
+        if(not _open) return;
+
+        static constexpr char exit_seq[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+        _flush(exit_seq, sizeof(exit_seq) - 1);
+
+        if(_raw) tcsetattr(_in_fd, TCSAFLUSH, &_saved_termios);
+        sigaction(SIGWINCH, &_saved_winch, nullptr);
+        _raw = false;
+        _open = false;
+    }
+
+    void AnsiPresenter::present(std::span<const char> frame, Coords res,
+                                std::span<const DirtySpan> spans, PresentStats& stats) {
+        if(spans.empty() or res.x <= 0) return;
+
+        std::size_t worst_case = max_cursor_move;
+        for(const DirtySpan& span : spans) {
+            const std::size_t rows = (span.length / res.x) + 2;
+            worst_case += (span.length * max_glyph_size) + (rows * max_cursor_move);
+        }
+        _reserve(worst_case);
+
+        char* const begin = _out.data();
+        char* out = begin;
+        if(_clear_pending) {
+            out = API_ANSI_LITERAL(out, "\x1b[2J");
+            _cursor = Coords{ -1, -1 };
+            _clear_pending = false;
+        }
+
+        for(const DirtySpan& span : spans) {
+            int x = span.x, y = span.y;
+            int remaining = span.length;
+
+            /// Wrapping spans are split per row so we never depend on the terminal's autowrap
+            while(remaining > 0 and y < res.y) {
+                const int run = std::min(remaining, res.x - x);
+                if(_cursor.x != x or _cursor.y != y) {
+                    out = _move_cursor(out, x, y);
+                    ++stats.spans;
+                }
+
+                const auto* cells = reinterpret_cast<const unsigned char*>(frame.data() + x + (y * res.x));
+                for(int i = 0; i < run; ++i) {
+                    const Glyph& glyph = glyph_table[cells[i]];
+                    std::memcpy(out, glyph.data, max_glyph_size);
+                    out += glyph.size;
+                }
+
+                stats.cells += run;
+                _cursor = (x + run < res.x) ? Coords{ x + run, y } : Coords{ -1, -1 };
+                remaining -= run;
+                x = 0, ++y;
+            }
+        }
+
+        const auto size = static_cast<std::size_t>(out - begin);
+        _flush(begin, size);
+        stats.bytes += size;
+    }
+
+    void AnsiPresenter::resize(MAYBE_UNUSED Coords res) NOEXCEPT {
+        _cursor = Coords{ -1, -1 };
+        _clear_pending = true;
+    }
+
+    bool AnsiPresenter::poll_resize(Coords& new_res) NOEXCEPT {
+        if(not resize_pending) LIKELY { return false; }
+        resize_pending = 0;
+
+        Coords size = get_terminal_size();
+        if(not size.area()) return false;
+        new_res = size;
+        return true;
+    }
+
+    PresenterType AnsiPresenter::type() CNOEXCEPT {
+        return eAnsiPresenter;
+    }
+
+    Coords AnsiPresenter::get_terminal_size() CNOEXCEPT {
+        winsize ws {};
+        if(ioctl(_out_fd, TIOCGWINSZ, &ws) != 0) return { 0, 0 };
+        return { ws.ws_col, ws.ws_row };
+    }
+
+    char* AnsiPresenter::_move_cursor(char* out, int x, int y) NOEXCEPT {
+        out = API_ANSI_LITERAL(out, "\x1b[");
+        out = std::to_chars(out, out + 5, y + 1).ptr;
+        *out++ = ';';
+        out = std::to_chars(out, out + 5, x + 1).ptr;
+        *out++ = 'H';
+        _cursor = Coords{ x, y };
+        return out;
+    }
+
+    void AnsiPresenter::_reserve(std::size_t size) NOEXCEPT {
+        if(_out.size() < size) UNLIKELY {
+            _out.resize(size + (size / 2));
+        }
+    }
+
+    void AnsiPresenter::_flush(const char* data, std::size_t size) NOEXCEPT {
+        /// A tty may accept less than the full frame, keep going until it's all out
+        while(size > 0) {
+            const ssize_t written = write(_out_fd, data, size);
+            if(written < 0) {
+                if(errno == EINTR) continue;
+                handle_last_error(__FILE__, __LINE__, "write", false);
+                _cursor = Coords{ -1, -1 };
+                return;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+}
+#endif
@@ -0,0 +1,56 @@
+#ifndef PROJECT3_TEST_PRESENTER_ANSI_HPP
+#define PROJECT3_TEST_PRESENTER_ANSI_HPP
+
+#include <vector>
+#include <api/presenter_types/ipresenter.hpp>
+
+#if API_POSIX
+#include <csignal>
+#include <termios.h>
+
+namespace api {
+    /**
+     * Writes frames to a VT100 compatible terminal.
+     * Every frame is encoded into a single preallocated byte buffer
+     * (cursor moves + UTF-8 glyphs) and flushed with one write().
+     */
+    struct AnsiPresenter final : IPresenter {
+        AnsiPresenter() = default;
+        explicit AnsiPresenter(int out_fd, int in_fd = 0) : _out_fd(out_fd), _in_fd(in_fd) {}
+
+        AnsiPresenter(const AnsiPresenter&) = delete;
+        ~AnsiPresenter() override;
+
+        bool open() override;
+        void close() override;
+        void present(std::span<const char> frame, Coords res,
+                     std::span<const DirtySpan> spans, PresentStats& stats) override;
+        void resize(Coords res) NOEXCEPT override;
+        bool poll_resize(Coords& new_res) NOEXCEPT override;
+        NODISCARD PresenterType type() CNOEXCEPT override;
+
+        /// Size of the terminal in cells, or { 0,0 } if it can't be queried.
+        NODISCARD Coords get_terminal_size() CNOEXCEPT;
+
+    private:
+        char* _move_cursor(char* out, int x, int y) NOEXCEPT;
+        void _reserve(std::size_t size) NOEXCEPT;
+        void _flush(const char* data, std::size_t size) NOEXCEPT;
+
+    private:
+        int _out_fd = 1;
+        int _in_fd = 0;
+
+        std::vector<char> _out;             // Frame byte buffer, only grows
+        Coords _cursor = { -1, -1 };        // Terminal cursor after the last flush
+        bool _clear_pending = true;
+
+        bool _open = false;
+        bool _raw = false;
+        termios _saved_termios {};
+        struct sigaction _saved_winch {};
+    };
+}
+#endif
+
+#endif //PROJECT3_TEST_PRESENTER_ANSI_HPP
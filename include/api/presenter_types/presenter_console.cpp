@@ -0,0 +1,36 @@
+#include "presenter_console.hpp"
+
+#if API_WIN32
+namespace api {
+    bool ConsolePresenter::open() {
+        _cout_handle = GetStdHandle(STD_OUTPUT_HANDLE);
+        return _cout_handle != INVALID_HANDLE_VALUE;
+    }
+
+    void ConsolePresenter::close() {
+        _cout_handle = nullptr;
+    }
+
+    void ConsolePresenter::present(std::span<const char> frame, Coords res,
+                                   std::span<const DirtySpan> spans, PresentStats& stats) {
+        for(const DirtySpan& span : spans) {
+            DWORD written_characters;
+            const char* span_data = frame.data() + span.x + (span.y * res.x);
+            WriteConsoleOutputCharacterA(_cout_handle, span_data, span.length,
+                                         { (SHORT)span.x, (SHORT)span.y }, &written_characters);
+
+            stats.bytes += span.length;
+            stats.cells += span.length;
+            ++stats.spans;
+        }
+    }
+
+    void ConsolePresenter::resize(MAYBE_UNUSED Coords res) NOEXCEPT {
+        _cout_handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    }
+
+    PresenterType ConsolePresenter::type() CNOEXCEPT {
+        return eConsolePresenter;
+    }
+}
+#endif
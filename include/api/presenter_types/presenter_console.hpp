@@ -0,0 +1,26 @@
+#ifndef PROJECT3_TEST_PRESENTER_CONSOLE_HPP
+#define PROJECT3_TEST_PRESENTER_CONSOLE_HPP
+
+#include <api/presenter_types/ipresenter.hpp>
+
+#if API_WIN32
+namespace api {
+    /**
+     * Writes spans straight into the Win32 console buffer.
+     */
+    struct ConsolePresenter final : IPresenter {
+        ~ConsolePresenter() override = default;
+        bool open() override;
+        void close() override;
+        void present(std::span<const char> frame, Coords res,
+                     std::span<const DirtySpan> spans, PresentStats& stats) override;
+        void resize(Coords res) NOEXCEPT override;
+        NODISCARD PresenterType type() CNOEXCEPT override;
+
+    private:
+        HANDLE _cout_handle = nullptr;
+    };
+}
+#endif
+
+#endif //PROJECT3_TEST_PRESENTER_CONSOLE_HPP
@@ -13,10 +13,36 @@
 #include <type_traits>
 #include <utility>
 
-#define NOMINMAX 1      /// Stops min and max from being defined
-#define OEMRESOURCE     /// Allows us to load data created by winres
-#define UNICODE         /// Gets correct windows filesystem functions
-#include <Windows.h>
+#if defined(_WIN32)
+#  define API_WIN32 1
+#  define API_POSIX 0
+#else
+#  define API_WIN32 0
+#  define API_POSIX 1
+#endif
+
+#if API_WIN32
+#  define NOMINMAX 1      /// Stops min and max from being defined
+#  define OEMRESOURCE     /// Allows us to load data created by winres
+#  define UNICODE         /// Gets correct windows filesystem functions
+#  include <Windows.h>
+#else
+#  include <cstdint>
+#  include <cstdlib>
+#  include <new>
+
+/// Minimal stand-ins so the platform independent parts of the api compile
+using SHORT = short;
+using DWORD = std::uint32_t;
+using HANDLE = void*;
+using LPCSTR = const char*;
+using LPCTSTR = const char*;
+
+struct POINT { long x, y; };
+struct COORD { SHORT X, Y; };
+
+#  define TEXT(str) str
+#endif
 
 #if defined(TRACY_ENABLE) && COMPILER_DEBUG
 #  include <tracy/Tracy.hpp>
@@ -57,9 +83,11 @@ T typed_alloc(std::size_t sz) noexcept {
 }
 
 inline void enable_ansi() noexcept {
+#if API_WIN32
     DWORD current_mode;
     GetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), &current_mode);
     SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), current_mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif
 }
 
 #endif //PROJECT3_TEST_WINAPI_HPP
@@ -240,6 +240,9 @@ const S3L_Index levelTriangleIndices[LEVEL_TRIANGLE_COUNT * 3] = {
 }; // levelTriangleIndices
 
 S3L_Model3D levelModel;
+S3L_Unit levelTriangleNormals[LEVEL_TRIANGLE_COUNT * 3];
+S3L_Unit levelCachedVertices[LEVEL_VERTEX_COUNT * 3];
+S3L_VertexCache levelVertexCache;
 
 void levelModelInit(void)
 {
@@ -249,6 +252,13 @@ void levelModelInit(void)
             levelTriangleIndices,
             LEVEL_TRIANGLE_COUNT,
             &levelModel);
+
+    TPE::compute_triangle_normals(&levelModel, levelTriangleNormals);
+    levelModel.triangleNormals = levelTriangleNormals;
+
+    /* The level never moves, so it's only transformed again when the camera does. */
+    S3L_vertexCacheInit(levelCachedVertices, &levelVertexCache);
+    levelModel.vertexCache = &levelVertexCache;
 }
 
 #endif //PROJECT3_TEST_LEVEL_MODEL_HPP
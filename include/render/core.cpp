@@ -1,6 +1,12 @@
 #include "core.hpp"
+#include "obj_loader.hpp"
+#include "mesh_simplify.hpp"
+#include <bit>
+#include <cmath>
 #include <exception>
 #include <fstream>
+#include <system_error>
+#include <utility>
 
 #if ENABLE_RENDER_MESSAGES
 #  define MODEL_PRINT(...) std::printf(__VA_ARGS__);
@@ -9,91 +15,280 @@
 #endif
 
 namespace TPE {
+    namespace {
+        /**
+         * Layout of a mesh cache: the header, then the vertices, faces and the name.
+         * Stamped with the source file's size and write time, so edits invalidate it.
+         */
+        struct alignas(8) MeshCacheHeader {
+            char magic[4];
+            std::uint32_t version;
+            std::uint64_t source_size;
+            std::int64_t source_time;
+            std::uint32_t vertex_values;
+            std::uint32_t face_values;
+            std::uint16_t unit_size;
+            std::uint16_t index_size;
+            std::uint32_t winding;
+            std::uint32_t name_size;
+        };
+
+        constexpr char mesh_cache_magic[4] { 'A', 'E', 'M', 'C' };
+        constexpr std::uint32_t mesh_cache_version = 2;
+
+        static_assert(sizeof(MeshCacheHeader) % alignof(S3L_Unit) == 0);
+        static_assert(sizeof(S3L_Unit) % alignof(S3L_Index) == 0);
+
+        fs::path mesh_cache_path(const fs::path& source) {
+            fs::path path = source;
+            path += ".mesh";
+            return path;
+        }
+
+        bool stamp_source(const fs::path& source, MeshCacheHeader& header) {
+            std::error_code ec;
+            header.source_size = fs::file_size(source, ec);
+            if(ec) return false;
+            header.source_time = fs::last_write_time(source, ec).time_since_epoch().count();
+            return not ec;
+        }
+    }
+
     ObjectModel::ObjectModel(const fs::path& filepath, WindingOrder wo) {
         load_model(filepath, wo);
     }
 
+    ObjectModel::ObjectModel(ObjectModel&& rhs) NOEXCEPT {
+        *this = std::move(rhs);
+    }
+
+    ObjectModel& ObjectModel::operator=(ObjectModel&& rhs) NOEXCEPT {
+        if(this == &rhs) return *this;
+        _filepath = std::move(rhs._filepath);
+        _name = std::move(rhs._name);
+        _vertices = std::move(rhs._vertices);
+        _faces = std::move(rhs._faces);
+        _mesh_cache = std::move(rhs._mesh_cache);
+        _vertex_data = std::exchange(rhs._vertex_data, {});
+        _face_data = std::exchange(rhs._face_data, {});
+        _normals = std::move(rhs._normals);
+        _cached_vertices = std::move(rhs._cached_vertices);
+        _lods = std::move(rhs._lods);
+        _radius = rhs._radius;
+        _model = std::exchange(rhs._model, {});
+        _color = rhs._color;
+        _locked = std::exchange(rhs._locked, false);
+        _static = rhs._static;
+
+        /// Vector buffers move with their data, only the caches stored inline don't
+        if(_locked) _update_vertex_cache();
+        return *this;
+    }
+
     bool ObjectModel::load_model(const fs::path& filepath, WindingOrder wo) {
         if(_locked) return false;
         if(not filepath.empty()) {
             _name.clear();
             _vertices.clear();
             _faces.clear();
+            _mesh_cache.close();
+            _vertex_data = {};
+            _face_data = {};
         }
 
         _filepath = filepath;
         auto abs_path = api::ResourceLocator::get_file(_filepath);
-        std::ifstream is { abs_path };
-        debug_assert(is.is_open());
-        if(not is.is_open()) return false;
+        if(_load_mesh_cache(abs_path, wo)) return true;
 
-        char type;
-        std::string line;
-        double x, y, z;
-        TPE_Unit v1, v2, v3;
+        render::ObjMesh mesh;
+        const bool loaded = render::load_obj(abs_path, mesh, wo == WindingOrder::eClockwise);
+        debug_assert(loaded);
+        if(not loaded) return false;
 
-        auto skipline = [&] { std::getline(is, line); };
-
-        while(not is.eof()) {
-            if(not (is >> type)) {
-                skipline();
-                continue;
-            }
-
-            if(type == 'o') is >> _name;
-            else if(type == 'v') {
-                is >> x >> y >> z;
-                constexpr std::size_t scale_factor = TPE_FRACTIONS_PER_UNIT;
-                _vertices.push_back(TPE_Unit(x * scale_factor));
-                _vertices.push_back(TPE_Unit(y * scale_factor));
-                _vertices.push_back(TPE_Unit(z * scale_factor));
-                MODEL_PRINT("vert: %lli, %lli, %lli\n",
-                            TPE_Unit(x * scale_factor), TPE_Unit(y * scale_factor), TPE_Unit(z * scale_factor))
-            }
-            else if(type == 'f') {
-                is >> v1 >> v2 >> v3;
-                if(wo == WindingOrder::eClockwise) std::swap(v1, v3);
-                _faces.push_back(--v1);
-                _faces.push_back(--v2);
-                _faces.push_back(--v3);
-                MODEL_PRINT("face: %lli, %lli, %lli\n", v1, v2, v3)
-            }
-            else skipline();
-        }
+        _name = std::move(mesh.name);
+        _vertices = std::move(mesh.vertices);
+        _faces = std::move(mesh.faces);
+        MODEL_PRINT("%s: %zu vertices, %zu faces\n", _name.c_str(), _vertices.size() / 3, _faces.size() / 3)
 
+        _vertex_data = _vertices;
+        _face_data = _faces;
+        _write_mesh_cache(abs_path, wo);
         return true;
     }
 
-    bool ObjectModel::compile_model() NOEXCEPT {
+    bool ObjectModel::compile_model(std::size_t lod_levels) NOEXCEPT {
         if(_locked) return false;
         if(not _check_validity()) return false;
 
-        S3L_model3DInit(_vertices.data(), vertex_count(),
-                        _faces.data(), face_count(), &_model);
+        S3L_model3DInit(_vertex_data.data(), vertex_count(),
+                        _face_data.data(), face_count(), &_model);
+
+        _normals.resize(_face_data.size());
+        compute_triangle_normals(&_model, _normals.data());
+        _model.triangleNormals = _normals.data();
+
+        double radius_sq = 0.0;
+        for(std::size_t i = 0; i < _vertex_data.size(); i += 3) {
+            const double x = _vertex_data[i], y = _vertex_data[i + 1], z = _vertex_data[i + 2];
+            radius_sq = std::max(radius_sq, x * x + y * y + z * z);
+        }
+        _radius = std::sqrt(radius_sq);
+
+        _lods.clear();
+        for(render::SimplifiedMesh& mesh : render::build_lod_chain(_vertex_data, _face_data, lod_levels)) {
+            LodLevel& lod = _lods.emplace_back();
+            lod.vertices = std::move(mesh.vertices);
+            lod.faces = std::move(mesh.faces);
+            lod.error = mesh.error;
+        }
+
+        /// Models point into their level, so only set up once _lods stops moving
+        for(LodLevel& lod : _lods) {
+            S3L_model3DInit(lod.vertices.data(), lod.vertices.size() / 3,
+                            lod.faces.data(), lod.faces.size() / 3, &lod.model);
+            lod.normals.resize(lod.faces.size());
+            compute_triangle_normals(&lod.model, lod.normals.data());
+            lod.model.triangleNormals = lod.normals.data();
+            lod.model.config = _model.config;
+        }
+        if(not _lods.empty()) {
+            MODEL_PRINT("%s: %zu levels of detail, down to %zu faces\n",
+                        _name.c_str(), _lods.size(), _lods.back().faces.size() / 3)
+        }
+
+        _update_vertex_cache();
 
         _locked = true;
         return true;
     }
 
+    void ObjectModel::set_static(api::toggle state) NOEXCEPT {
+        _static = state;
+        if(_locked) _update_vertex_cache();
+    }
+
+    S3L_Model3D* ObjectModel::select_lod(const S3L_Camera& camera, TPE_Vec3 pos, TPE_Vec3 scale) CNOEXCEPT {
+        if(_lods.empty()) return &_model;
+
+        const double dx = double(pos.x) - camera.transform.translation.x;
+        const double dy = double(pos.y) - camera.transform.translation.y;
+        const double dz = double(pos.z) - camera.transform.translation.z;
+        const double max_scale = double(std::max({ S3L_abs(scale.x), S3L_abs(scale.y), S3L_abs(scale.z) }))
+                                 / S3L_FRACTIONS_PER_UNIT;
+
+        /// Distance to the nearest point the model could reach, anything closer gets full detail
+        const double distance = std::sqrt(dx * dx + dy * dy + dz * dz) - _radius * max_scale;
+        if(distance <= 0.0) return &_model;
+
+        /// Screen cells covered by one model unit at that distance, see S3L_mapProjectionPlaneToScreen
+        const double cells_per_unit = max_scale * double(camera.focalLength) / distance
+                                      * double(S3L_HALF_RESOLUTION_X) / S3L_FRACTIONS_PER_UNIT;
+
+        for(auto lod = _lods.rbegin(); lod != _lods.rend(); ++lod) {
+            if(lod->error * cells_per_unit <= lod_pixel_error) return &lod->model;
+        }
+        return &_model;
+    }
+
     std::size_t ObjectModel::vertex_count() CNOEXCEPT {
         debug_assert(_check_validity());
-        return _vertices.size() / 3;
+        return _vertex_data.size() / 3;
     }
 
     std::size_t ObjectModel::face_count() CNOEXCEPT {
         debug_assert(_check_validity());
-        return _faces.size() / 3;
+        return _face_data.size() / 3;
     }
 
     bool ObjectModel::_check_validity() CNOEXCEPT {
-        bool valid_verts = (not _vertices.empty()) and (_vertices.size() % 3 == 0);
-        bool valid_faces = (not _faces.empty()) and (_faces.size() % 3 == 0);
+        bool valid_verts = (not _vertex_data.empty()) and (_vertex_data.size() % 3 == 0);
+        bool valid_faces = (not _face_data.empty()) and (_face_data.size() % 3 == 0);
         return valid_verts and valid_faces;
     }
 
+    bool ObjectModel::_load_mesh_cache(const fs::path& source, WindingOrder wo) NOEXCEPT {
+        MeshCacheHeader stamp {};
+        if(not stamp_source(source, stamp)) return false;
+        if(not _mesh_cache.open(mesh_cache_path(source))) return false;
+
+        const auto data = _mesh_cache.data();
+        MeshCacheHeader header;
+        if(data.size() < sizeof(header)) return _mesh_cache.close(), false;
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        const std::size_t vertex_bytes = std::size_t(header.vertex_values) * sizeof(S3L_Unit);
+        const std::size_t face_bytes = std::size_t(header.face_values) * sizeof(S3L_Index);
+        const bool valid =
+            std::memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) == 0 and
+            header.version == mesh_cache_version and
+            header.unit_size == sizeof(S3L_Unit) and header.index_size == sizeof(S3L_Index) and
+            header.winding == std::uint32_t(wo) and
+            header.source_size == stamp.source_size and header.source_time == stamp.source_time and
+            data.size() == sizeof(header) + vertex_bytes + face_bytes + header.name_size;
+        if(not valid) return _mesh_cache.close(), false;
+
+        /// The mapping is page aligned and the header keeps the arrays aligned
+        const std::byte* begin = data.data() + sizeof(header);
+        _vertex_data = { reinterpret_cast<const S3L_Unit*>(begin), header.vertex_values };
+        _face_data = { reinterpret_cast<const S3L_Index*>(begin + vertex_bytes), header.face_values };
+        _name.assign(reinterpret_cast<const char*>(begin + vertex_bytes + face_bytes), header.name_size);
+        return true;
+    }
+
+    void ObjectModel::_write_mesh_cache(const fs::path& source, WindingOrder wo) CNOEXCEPT {
+        MeshCacheHeader header {};
+        if(not stamp_source(source, header)) return;
+        std::memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+        header.version = mesh_cache_version;
+        header.vertex_values = static_cast<std::uint32_t>(_vertices.size());
+        header.face_values = static_cast<std::uint32_t>(_faces.size());
+        header.unit_size = sizeof(S3L_Unit);
+        header.index_size = sizeof(S3L_Index);
+        header.winding = std::uint32_t(wo);
+        header.name_size = static_cast<std::uint32_t>(_name.size());
+
+        /// Written to a temporary first, so a half written cache is never picked up
+        const fs::path path = mesh_cache_path(source);
+        fs::path tmp_path = path;
+        tmp_path += ".tmp";
+        {
+            std::ofstream os { tmp_path, std::ios::binary | std::ios::trunc };
+            os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            os.write(reinterpret_cast<const char*>(_vertices.data()), std::streamsize(_vertices.size() * sizeof(S3L_Unit)));
+            os.write(reinterpret_cast<const char*>(_faces.data()), std::streamsize(_faces.size() * sizeof(S3L_Index)));
+            os.write(_name.data(), std::streamsize(_name.size()));
+            if(not os) {
+                debug_printf("_write_mesh_cache(): %s could not be written.", path.string().c_str());
+                return;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tmp_path, path, ec);
+        if(ec) fs::remove(tmp_path, ec);
+    }
+
+    void ObjectModel::_update_vertex_cache() NOEXCEPT {
+        if(not _static) {
+            _model.vertexCache = nullptr;
+            for(LodLevel& lod : _lods) lod.model.vertexCache = nullptr;
+            return;
+        }
+
+        _cached_vertices.resize(_vertex_data.size());
+        S3L_vertexCacheInit(_cached_vertices.data(), &_vertex_cache);
+        _model.vertexCache = &_vertex_cache;
+
+        for(LodLevel& lod : _lods) {
+            lod.cached_vertices.resize(lod.vertices.size());
+            S3L_vertexCacheInit(lod.cached_vertices.data(), &lod.vertex_cache);
+            lod.model.vertexCache = &lod.vertex_cache;
+        }
+    }
+
 
-    ECSentry::ECSentry(ECS* e, std::size_t idx) : _bound_ecs(e), _entity(idx) {
-        debug_assert(e->_skiplist[idx]);
+    ECSentry::ECSentry(ECS* e, EntityHandle handle) : _bound_ecs(e), _entity(handle) {
+        debug_assert(e->is_alive(handle), "Stale entity handle.");
     }
 
     ECSentry::ECSentry(ECSentry&& rhs) NOEXCEPT
@@ -105,13 +300,14 @@ namespace TPE {
 
     TPE_Body* ECSentry::_get_body() NOEXCEPT { return _bound_ecs->_get_body(_entity); }
     TPE_Body* ECSentry::_get_body() CNOEXCEPT { return _bound_ecs->_get_body(_entity); }
+    bool ECSentry::is_alive() CNOEXCEPT { return _bound_ecs and _bound_ecs->is_alive(_entity); }
 
 
     ECS::ECS() NOEXCEPT {
         TPE_worldInit(&_game_world, _bodies.data(), 0, nullptr);
-        std::size_t player_pos = add_2Line(400, 300, 400);
-        _name_map["$PLAYER"] = player_pos;
-        _names[player_pos] = "$PLAYER";
+        EntityHandle player = add_2Line(400, 300, 400);
+        _name_map["$PLAYER"] = player.index;
+        _names[player.index] = "$PLAYER";
     }
 
     std::size_t ECS::get_microseconds() NOEXCEPT {
@@ -120,58 +316,64 @@ namespace TPE {
         return us.count();
     }
 
-    std::size_t ECS::add_triangle(TPE_Unit s, TPE_Unit d, TPE_Unit mass) NOEXCEPT {
-        TPE_makeTriangle(_joint_data(),_connect_data(),s,d);
+    EntityHandle ECS::add_triangle(TPE_Unit s, TPE_Unit d, TPE_Unit mass) NOEXCEPT {
+        TPE_makeTriangle(_joint_data(3),_connect_data(3),s,d);
         return _add_body(3,3,mass);
     }
 
-    std::size_t ECS::add_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
-        TPE_makeBox(_joint_data(),_connect_data(),w,h,d,joint_size);
+    EntityHandle ECS::add_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
+        TPE_makeBox(_joint_data(8),_connect_data(16),w,h,d,joint_size);
         return _add_body(8,16,mass);
     }
 
-    std::size_t ECS::add_centered_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
-        TPE_makeCenterBox(_joint_data(),_connect_data(),w,h,d,joint_size);
+    EntityHandle ECS::add_centered_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
+        TPE_makeCenterBox(_joint_data(9),_connect_data(18),w,h,d,joint_size);
         return _add_body(9,18,mass);
     }
 
-    std::size_t ECS::add_2Line(TPE_Unit w, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
-        TPE_make2Line(_joint_data(),_connect_data(),w,joint_size);
+    EntityHandle ECS::add_2Line(TPE_Unit w, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
+        TPE_make2Line(_joint_data(2),_connect_data(1),w,joint_size);
         return _add_body(2,1,mass);
     }
 
-    std::size_t ECS::add_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
-        TPE_makeRect(_joint_data(),_connect_data(),w,d,joint_size);
+    EntityHandle ECS::add_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
+        TPE_makeRect(_joint_data(4),_connect_data(6),w,d,joint_size);
         return _add_body(4,6,mass);
     }
 
-    std::size_t ECS::add_centered_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
-        TPE_makeCenterRect(_joint_data(),_connect_data(),w,d,joint_size);
+    EntityHandle ECS::add_centered_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
+        TPE_makeCenterRect(_joint_data(5),_connect_data(8),w,d,joint_size);
         return _add_body(5,8,mass);
     }
 
-    std::size_t ECS::add_centered_rect_full(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
-        TPE_makeCenterRectFull(_joint_data(),_connect_data(),w,d,joint_size);
+    EntityHandle ECS::add_centered_rect_full(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT {
+        TPE_makeCenterRectFull(_joint_data(5),_connect_data(10),w,d,joint_size);
         return _add_body(5,10,mass);
     }
 
-    std::size_t ECS::add_ball(TPE_Unit s, TPE_Unit mass) NOEXCEPT {
-        (*_joint_data()) = TPE_joint(TPE_vec3(0,0,0),s);
+    EntityHandle ECS::add_ball(TPE_Unit s, TPE_Unit mass) NOEXCEPT {
+        (*_joint_data(1)) = TPE_joint(TPE_vec3(0,0,0),s);
         return _add_body(1,0,mass);
     }
 
-    ECSentry ECS::bind(std::size_t idx) NOEXCEPT {
-        return { this, idx };
+    ECSentry ECS::bind(EntityHandle handle) NOEXCEPT {
+        return { this, handle };
     }
 
     ECSentry ECS::bind(std::string name) NOEXCEPT {
         debug_assert(_name_map.contains(name));
         std::size_t idx = _name_map[name];
-        return { this, idx };
+        return { this, _handle(idx) };
     }
 
     PlayerBody ECS::get_player() NOEXCEPT {
-        return { bind(0) };
+        return { bind(_handle(0)) };
+    }
+
+    bool ECS::is_alive(EntityHandle handle) CNOEXCEPT {
+        return handle.index < _generations.size()
+            and _generations[handle.index] == handle.generation
+            and _is_assigned(handle.index);
     }
 
     void ECS::register_env(TPE_ClosestPointFunction func) NOEXCEPT {
@@ -180,14 +382,18 @@ namespace TPE {
     }
 
     void ECS::tick() NOEXCEPT {
-        TPE_worldStep(&_game_world);
-
-        for(std::size_t idx = 0; idx < _assigned_indices; ++idx) {
-            if(not _skiplist[idx] or _disabled[idx]) continue;
-            TPE_Body* curr_body = &_bodies[_bodies_idx[idx]];
-
-            if(_has_gravity[idx]) TPE_bodyApplyGravity(curr_body, _gravity);
+        const int groups = TPE_worldStepBegin(&_game_world);
+        if(groups > 1) {
+            if(not _physics_pool) _physics_pool = std::make_unique<api::WorkerPool>();
+            _physics_pool->parallel_for(groups, [this](int group) {
+                TPE_worldStepGroup(&_game_world, static_cast<uint16_t>(group));
+            });
         }
+        else if(groups == 1) TPE_worldStepGroup(&_game_world, 0);
+        TPE_worldStepEnd(&_game_world);
+
+        for(std::size_t n = 0; n < _falling_count; ++n)
+            TPE_bodyApplyGravity(&_bodies[_bodies_idx[_falling[n]]], _gravity);
 
         ++current_frame;
     }
@@ -205,66 +411,103 @@ namespace TPE {
     }
 
     std::size_t ECS::_next_free_index() NOEXCEPT {
-        std::size_t index = 0;
-        for(bool b : _skiplist) {
-            if(not b) break;
-            ++index;
+        for(std::size_t word = _free_slot_hint; word < _assigned_slots.size(); ++word) {
+            const std::uint64_t free = ~_assigned_slots[word];
+            if(not free) continue;
+
+            const int bit = std::countr_zero(free);
+            _assigned_slots[word] |= std::uint64_t(1) << bit;
+            _free_slot_hint = word;
+            return word * 64 + bit;
         }
 
-        _skiplist[index] = true;
-        if(_assigned_indices == index) ++_assigned_indices;
-        return index;
+        _grow();
+        return _next_free_index();
     }
 
-    std::size_t ECS::_add_body(int joints, int conns, TPE_Unit mass) NOEXCEPT {
+    void ECS::_grow() NOEXCEPT {
+        const std::size_t size = (_assigned_slots.size() + 1) * 64;
+        if(size > max_entities + 64) FATAL("ECS is full.");
+
+        _assigned_slots.push_back(0);
+        /// The last slot of the last word would overflow the 16 bit body indices
+        if(size > max_entities) _assigned_slots.back() = std::uint64_t(1) << 63;
+
+        _generations.resize(size);
+        _bodies_idx.resize(size);
+        _names.resize(size);
+        _mass.resize(size);
+        _color.resize(size);
+        _disabled.resize(size);
+        _has_gravity.resize(size);
+        _always_active.resize(size);
+        _is_sphere.resize(size);
+        _do_rotation.resize(size);
+        _falling.resize(size);
+        _falling_pos.resize(size);
+
+        _bodies.resize(size);
+        _game_world.bodies = _bodies.data();
+    }
+
+    EntityHandle ECS::_add_body(int joints, int conns, TPE_Unit mass) NOEXCEPT {
         const std::size_t idx = _next_free_index();
 
         _body_added(joints, conns, mass);
         _bodies_idx[idx] = _active_bodies - 1;
         _mass[idx] = mass;
-        _has_gravity[idx] = (mass != 0);
+        _set_falling(idx, mass != 0);
         _color[idx] = { 0, 255 };
         _index_map[_bodies_idx[idx]] = idx;
 
-        return idx;
+        return _handle(idx);
     }
 
-    std::size_t ECS::_add_body(std::string name, int joints, int conns, TPE_Unit mass) NOEXCEPT {
+    EntityHandle ECS::_add_body(std::string name, int joints, int conns, TPE_Unit mass) NOEXCEPT {
         debug_assert(not _name_map.contains(name));
-        const std::size_t idx = _add_body(joints, conns, mass);
+        const EntityHandle handle = _add_body(joints, conns, mass);
 
         if(not name.empty()) {
-            _name_map[name] = idx;
-            _names[idx] = name;
+            _name_map[name] = handle.index;
+            _names[handle.index] = name;
         }
 
-        return idx;
+        return handle;
     }
 
     void ECS::_body_added(int joints, int conns, TPE_Unit mass) NOEXCEPT {
         TPE_bodyInit(&_bodies[_active_bodies],
-                     &_joints[_assigned_joints], joints,
-                     &_conns[_assigned_conns], conns, mass);
+                     _joints.allocate(joints), joints,
+                     _conns.allocate(conns), conns, mass);
 
         ++_active_bodies;
         ++_game_world.bodyCount;
-        _assigned_joints += joints;
-        _assigned_conns += conns;
     }
 
-    std::size_t ECS::_remove_body(std::size_t idx) NOEXCEPT {
-        debug_assert(_skiplist[idx]);
+    void ECS::_remove_body(EntityHandle handle) NOEXCEPT {
+        /// Another entry already removed it, the slot may belong to someone else by now
+        debug_assert(is_alive(handle), "Stale entity handle.");
+        if(not is_alive(handle)) return;
+
+        const std::size_t idx = handle.index;
+        ++_generations[idx];
         TPE_Unit body_idx = _bodies_idx[idx];
-        std::size_t swapped_idx = _body_removed(body_idx);
+        /// The last body in the world is moved into the hole
+        const auto last_body = static_cast<TPE_Unit>(_body_removed(body_idx));
+        const std::size_t swapped_idx = _index_map[last_body];
+
+        _set_falling(idx, false);
+        _assigned_slots[idx / 64] &= ~(std::uint64_t(1) << (idx % 64));
+        _free_slot_hint = std::min(_free_slot_hint, std::size_t(idx / 64));
 
-        _skiplist[idx] = false;
         _bodies_idx[swapped_idx] = body_idx;
         _index_map[body_idx] = swapped_idx;
+        _index_map.erase(last_body);
 
-        if(not _names[idx].empty())
+        if(not _names[idx].empty()) {
             _name_map.erase(_names[idx]);
-
-        return swapped_idx;
+            _names[idx].clear();
+        }
     }
 
     std::size_t ECS::_body_removed(TPE_Unit idx) NOEXCEPT {
@@ -275,7 +518,24 @@ namespace TPE {
         return _active_bodies;
     }
 
-    TPE_Vec3 get_triangle_normal(const S3L_Index* v, S3L_Model3D* drawn_model) {
+    void ECS::_set_falling(std::size_t idx, bool falling) NOEXCEPT {
+        if(_has_gravity[idx] == falling) return;
+        _has_gravity[idx] = falling;
+
+        if(falling) {
+            _falling_pos[idx] = static_cast<std::uint16_t>(_falling_count);
+            _falling[_falling_count++] = static_cast<std::uint16_t>(idx);
+        }
+        else {
+            /// Swap with the last entry to keep the list dense
+            const std::uint16_t pos = _falling_pos[idx];
+            const std::uint16_t last = _falling[--_falling_count];
+            _falling[pos] = last;
+            _falling_pos[last] = pos;
+        }
+    }
+
+    TPE_Vec3 get_triangle_normal(const S3L_Index* v, const S3L_Model3D* drawn_model) {
         #define VEC3C_FROM_IDX(v, c) drawn_model->vertices[(*v) * 3 + (c)]
         #define VEC3_FROM_IDX(v) TPE_vec3( VEC3C_FROM_IDX(v, 0), VEC3C_FROM_IDX(v, 1), VEC3C_FROM_IDX(v, 2) )
         TPE_Vec3 a = VEC3_FROM_IDX(v); ++v;
@@ -286,6 +546,15 @@ namespace TPE {
 
         return TPE_vec3Normalized(TPE_vec3Cross(TPE_vec3Minus(c,a), TPE_vec3Minus(c,b)));
     }
+
+    void compute_triangle_normals(const S3L_Model3D* model, S3L_Unit* normals) {
+        for(S3L_Index i = 0; i < model->triangleCount; ++i) {
+            TPE_Vec3 normal = get_triangle_normal(model->triangles + (i * 3), model);
+            normals[i * 3 + 0] = normal.x;
+            normals[i * 3 + 1] = normal.y;
+            normals[i * 3 + 2] = normal.z;
+        }
+    }
 }
 
 
@@ -299,21 +568,12 @@ namespace render {
     void initialize_buffer(api::Framebuffer<char>& framebuffer) NOEXCEPT {
         initialize_screen(framebuffer.get_coords());
         internal_buffer<char> = framebuffer;
+        begin_frame();
     }
 
-    void draw_pixel(int x, int y, uint8_t color, uint8_t luminance) {
-        debug_assert(not (x < 0 or y < 0 or x > TRES_X or y > TRES_Y), "Invalid screen coordinates.");
-
-        uint8_t c;
-        if(color == 0) {
-            long offset = double(luminance / 255.0) * sizeof(world_color);
-            c = world_color[offset];
-        }
-        else {
-            luminance = luminance / sizeof(render::ColorGrade);
-            luminance = (luminance > 15) ? 15 : luminance;
-            c = render::color_grades[color - 1][luminance];
-        }
-        internal_buffer<char>->get_active_buffer()->set_value({ x, y }, c);
+    void begin_frame() NOEXCEPT {
+        auto active_buffer = internal_buffer<char>->get_active_buffer();
+        frame_data = active_buffer->raw_data();
+        frame_stride = active_buffer->get_x();
     }
 }
\ No newline at end of file
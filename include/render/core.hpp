@@ -10,14 +10,19 @@
 
 #include <array>
 #include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <vector>
 
 #include <render/tinyphysicsengine.hpp>
 #include <render/small3dlib.hpp>
 
 #include <api/core.hpp>
+#include <api/detail/worker_pool.hpp>
 #include <api/framebuffer.hpp>
 #include <api/input.hpp>
+#include <api/mapped_file.hpp>
 #include <api/resource_locator.hpp>
 
 #define FPS 90
@@ -29,21 +34,46 @@
 #define TRES_X (RES_X)
 #define TRES_Y ((RES_Y / 2))
 
-#define ECS_MAX_SIZE 4096L
-#define JOINTS_MAX_SIZE (ECS_MAX_SIZE * 8L)
-#define CONNS_MAX_SIZE (JOINTS_MAX_SIZE * 2L)
 #define TO_LUM(value) (255 * (value) / sizeof(render::ColorGrade))
 
 template <typename T>
-using ECSentry_t = std::array<T, ECS_MAX_SIZE>;
+using ECSentry_t = std::vector<T>;
 
 void helper_set3DColor(uint8_t p, uint8_t a = 255);
 void helper_drawModel(S3L_Model3D *model, TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot);
+const S3L_Camera& helper_getCamera();
 
 namespace TPE {
-    using Bodies_t = std::array<TPE_Body, ECS_MAX_SIZE>;
-    using Joints_t = std::array<TPE_Joint, JOINTS_MAX_SIZE>;
-    using Connections_t = std::array<TPE_Connection, CONNS_MAX_SIZE>;
+    /**
+     * Hands out runs of T from fixed size chunks, allocated as they fill up.
+     * Chunks never move, so pointers into them stay valid while the pool grows.
+     */
+    template <typename T, std::size_t ChunkSize>
+    struct ChunkedPool {
+        /// Room for `count` elements in a row, which the next allocate(count) returns.
+        T* peek(std::size_t count) NOEXCEPT {
+            debug_assert(count <= ChunkSize, "Run larger than a chunk.");
+            if(_chunks.empty() or _used + count > ChunkSize) {
+                _chunks.push_back(std::make_unique<T[]>(ChunkSize));
+                _used = 0;
+            }
+            return _chunks.back().get() + _used;
+        }
+
+        T* allocate(std::size_t count) NOEXCEPT {
+            T* data = peek(count);
+            _used += count;
+            return data;
+        }
+
+    private:
+        std::vector<std::unique_ptr<T[]>> _chunks;
+        std::size_t _used = 0;
+    };
+
+    using Bodies_t = std::vector<TPE_Body>;
+    using Joints_t = ChunkedPool<TPE_Joint, 1024>;
+    using Connections_t = ChunkedPool<TPE_Connection, 2048>;
 
     inline constexpr TPE_Unit immovable = 100000;
 
@@ -61,44 +91,93 @@ namespace TPE {
         eCW = eClockwise, eCCW = eCounterClockwise,
     };
 
+    /**
+     * Loaded from .obj files. The parsed mesh is saved next to the source as a binary
+     * cache (<name>.obj.mesh), which later loads are mapped from directly.
+     * Compiled models can carry simplified levels of detail, picked by how large
+     * the model is on screen.
+     */
     struct ObjectModel {
+        /// A level is used while its error covers less than this many cells on screen.
+        static constexpr double lod_pixel_error = 0.5;
+
         ObjectModel() = default;
         ObjectModel(const fs::path& filepath, WindingOrder wo = WindingOrder::eClockwise);  // NOLINT
+        /// The models point at the vertex caches they own, so moves re-seat them.
+        ObjectModel(ObjectModel&& rhs) NOEXCEPT;
+        ObjectModel& operator=(ObjectModel&& rhs) NOEXCEPT;
 
         bool load_model(const fs::path& filepath, WindingOrder wo = WindingOrder::eClockwise);
-        bool compile_model() NOEXCEPT;
+        /// Builds up to `lod_levels` simplified meshes, each with about half the triangles of the last.
+        bool compile_model(std::size_t lod_levels = 0) NOEXCEPT;
         void set_color(std::uint8_t color) NOEXCEPT { _color = color; }
+        /// Static models keep their transformed vertices until they or the camera move.
+        void set_static(api::toggle state) NOEXCEPT;
         S3L_Model3D& get_model() CNOEXCEPT { return _model; }
         S3L_Model3D* pget_model() CNOEXCEPT { return &_model; }
+        /// The coarsest level that still looks the same at the given placement.
+        S3L_Model3D* select_lod(const S3L_Camera& camera, TPE_Vec3 pos, TPE_Vec3 scale) CNOEXCEPT;
 
         NODISCARD std::size_t vertex_count() CNOEXCEPT;
         NODISCARD std::size_t face_count() CNOEXCEPT;
+        NODISCARD std::size_t lod_count() CNOEXCEPT { return _lods.size(); }
         NODISCARD bool locked() CNOEXCEPT { return _locked; }
         NODISCARD std::uint8_t get_color() CNOEXCEPT { return _color; }
 
     private:
+        struct LodLevel {
+            std::vector<S3L_Unit> vertices;
+            std::vector<S3L_Index> faces;
+            std::vector<S3L_Unit> normals;
+            std::vector<S3L_Unit> cached_vertices;
+            double error;
+            mutable S3L_Model3D model;
+            S3L_VertexCache vertex_cache;
+        };
+
         NODISCARD bool _check_validity() CNOEXCEPT;
+        void _update_vertex_cache() NOEXCEPT;
+        bool _load_mesh_cache(const fs::path& source, WindingOrder wo) NOEXCEPT;
+        void _write_mesh_cache(const fs::path& source, WindingOrder wo) CNOEXCEPT;
 
     private:
         fs::path _filepath;
         std::string _name;
         std::vector<S3L_Unit> _vertices;
         std::vector<S3L_Index> _faces;
+        api::MappedFile _mesh_cache;
+        std::span<const S3L_Unit> _vertex_data;     // Either _vertices or the mesh cache
+        std::span<const S3L_Index> _face_data;
+        std::vector<S3L_Unit> _normals;
+        std::vector<S3L_Unit> _cached_vertices;
+        std::vector<LodLevel> _lods;
+        double _radius = 0.0;                       // Farthest vertex from the origin
 
         mutable S3L_Model3D _model = {};
+        S3L_VertexCache _vertex_cache = {};
         std::uint8_t _color = 1;
         bool _locked = false;
+        bool _static = false;
     };
 
     inline void draw_model(ObjectModel& m, TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot) {
         helper_set3DColor(m.get_color());
-        helper_drawModel(m.pget_model(), pos, scale, rot);
+        helper_drawModel(m.select_lod(helper_getCamera(), pos, scale), pos, scale, rot);
     }
 
     struct ECS;
 
+    /**
+     * An ECS idx and the generation of its slot when the entity was added.
+     * Removing the entity bumps the generation, so the handle can't alias whatever reuses the slot.
+     */
+    struct EntityHandle {
+        std::uint32_t index = 0;
+        std::uint32_t generation = 0;
+    };
+
     struct ECSentry {
-        ECSentry(ECS* e, std::size_t idx);
+        ECSentry(ECS* e, EntityHandle handle);
         ECSentry(const ECSentry&) = delete;
         ECSentry(ECSentry&& rhs) NOEXCEPT;
         ~ECSentry();
@@ -125,13 +204,16 @@ namespace TPE {
             return TPE_bodyGetRotation(_get_body(), joint1, joint2, joint3);
         }
 
+        /// False once the entity was removed through another entry.
+        NODISCARD bool is_alive() CNOEXCEPT;
+
     protected:
         TPE_Body* _get_body() NOEXCEPT;
         NODISCARD TPE_Body* _get_body() CNOEXCEPT;
 
     private:
         ECS* _bound_ecs = nullptr;
-        const std::size_t _entity;
+        const EntityHandle _entity;
         friend struct ECS;
     };
 
@@ -147,26 +229,31 @@ namespace TPE {
     };
 
     struct ECS {
+        /// Bodies are indexed with 16 bits by the physics engine.
+        static constexpr std::size_t max_entities = UINT16_MAX;
+
         ECS() NOEXCEPT;
         ECS(const ECS&) = delete;
         ECS(ECS&&) = delete;
 
         static std::size_t get_microseconds() NOEXCEPT;
 
-        std::size_t add_triangle(TPE_Unit s, TPE_Unit d, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_centered_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_2Line(TPE_Unit w, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_centered_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_centered_rect_full(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
-        std::size_t add_ball(TPE_Unit s, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_triangle(TPE_Unit s, TPE_Unit d, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_centered_box(TPE_Unit w, TPE_Unit h, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_2Line(TPE_Unit w, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_centered_rect(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_centered_rect_full(TPE_Unit w, TPE_Unit d, TPE_Unit joint_size, TPE_Unit mass) NOEXCEPT;
+        EntityHandle add_ball(TPE_Unit s, TPE_Unit mass) NOEXCEPT;
 
-        ECSentry bind(std::size_t idx) NOEXCEPT;
+        ECSentry bind(EntityHandle handle) NOEXCEPT;
         ECSentry bind(std::string name) NOEXCEPT;
         PlayerBody get_player() NOEXCEPT;
+        NODISCARD bool is_alive(EntityHandle handle) CNOEXCEPT;
 
         void register_env(TPE_ClosestPointFunction func) NOEXCEPT;
+        /// Steps the world, with independent islands of bodies solved in parallel.
         void tick() NOEXCEPT;
 
         NODISCARD TPE_ClosestPointFunction get_env() CNOEXCEPT;
@@ -175,46 +262,64 @@ namespace TPE {
 
     private:
         std::size_t _next_free_index() NOEXCEPT;
-        TPE_Joint* _joint_data() NOEXCEPT { return _joints.data() + _assigned_joints; }
-        TPE_Connection* _connect_data() NOEXCEPT { return _conns.data() + _assigned_conns; }
+        void _grow() NOEXCEPT;
+        /// Where the shape of the next body goes, which must have `count` joints/connections.
+        TPE_Joint* _joint_data(int count) NOEXCEPT { return _joints.peek(count); }
+        TPE_Connection* _connect_data(int count) NOEXCEPT { return _conns.peek(count); }
 
-        std::size_t _add_body(int joints, int conns, TPE_Unit mass) NOEXCEPT;
-        std::size_t _add_body(std::string name, int joints, int conns, TPE_Unit mass) NOEXCEPT;
+        EntityHandle _add_body(int joints, int conns, TPE_Unit mass) NOEXCEPT;
+        EntityHandle _add_body(std::string name, int joints, int conns, TPE_Unit mass) NOEXCEPT;
         void _body_added(int joints, int conns, TPE_Unit mass) NOEXCEPT;
-        std::size_t _remove_body(std::size_t idx) NOEXCEPT;
+        void _remove_body(EntityHandle handle) NOEXCEPT;
         std::size_t _body_removed(TPE_Unit idx) NOEXCEPT;
+        void _set_falling(std::size_t idx, bool falling) NOEXCEPT;
 
-        TPE_Body* _get_body(std::size_t idx) NOEXCEPT {
-            auto body_idx = _bodies_idx[idx];
+        NODISCARD bool _is_assigned(std::size_t idx) CNOEXCEPT {
+            return (_assigned_slots[idx / 64] >> (idx % 64)) & 1u;
+        }
+
+        NODISCARD EntityHandle _handle(std::size_t idx) CNOEXCEPT {
+            return { static_cast<std::uint32_t>(idx), _generations[idx] };
+        }
+
+        TPE_Body* _get_body(EntityHandle handle) NOEXCEPT {
+            debug_assert(is_alive(handle), "Stale entity handle.");
+            auto body_idx = _bodies_idx[handle.index];
             return &_bodies[body_idx];
         }
 
     protected:
-        ECSentry_t<bool> _skiplist = {};
-        ECSentry_t<TPE_Unit> _bodies_idx = {};
+        /// Bit `idx % 64` of word `idx / 64` is set while ECS idx is in use
+        /// Per entity storage grows by one word of slots at a time
+        std::vector<std::uint64_t> _assigned_slots;
+        std::size_t _free_slot_hint = 0;                /// Every word before this one is full
+        ECSentry_t<std::uint32_t> _generations;
+        ECSentry_t<TPE_Unit> _bodies_idx;
         ECSentry_t<std::string> _names;
-        ECSentry_t<TPE_Unit> _mass = {};
-        ECSentry_t<api::iVec2> _color = {};
+        ECSentry_t<TPE_Unit> _mass;
+        ECSentry_t<api::iVec2> _color;
 
-        ECSentry_t<bool> _disabled = {};
-        ECSentry_t<bool> _has_gravity = {};
-        ECSentry_t<bool> _always_active = {};
-        ECSentry_t<bool> _is_sphere = {};
-        ECSentry_t<bool> _do_rotation = {};
+        ECSentry_t<bool> _disabled;
+        ECSentry_t<bool> _has_gravity;
+        ECSentry_t<bool> _always_active;
+        ECSentry_t<bool> _is_sphere;
+        ECSentry_t<bool> _do_rotation;
 
-        std::size_t _assigned_indices = 0;
+        /// Dense list of the entities gravity applies to, in no particular order
+        ECSentry_t<std::uint16_t> _falling;
+        ECSentry_t<std::uint16_t> _falling_pos;         /// ECS idx -> position in _falling
+        std::size_t _falling_count = 0;
 
-        Bodies_t _bodies;
+        Bodies_t _bodies;                               /// Indexed by the world, reallocated as it grows
         Joints_t _joints;
         Connections_t _conns;
         TPE_Unit _active_bodies = 0;
-        TPE_Unit _assigned_joints = 0;
-        TPE_Unit _assigned_conns = 0;
 
         api::Map<std::string, std::size_t> _name_map;   /// Name -> ECS idx
         api::Map<TPE_Unit, std::size_t> _index_map;     /// World idx -> ECS idx
 
         TPE_World _game_world = {};
+        std::unique_ptr<api::WorkerPool> _physics_pool;  /// Started on the first tick with islands to share
         std::size_t current_frame = 0;
         TPE_ClosestPointFunction _environment_function = nullptr;
         TPE_Unit _gravity = 4;
@@ -222,7 +327,10 @@ namespace TPE {
         friend struct ECSentry;
     };
 
-    TPE_Vec3 get_triangle_normal(const S3L_Index* v, S3L_Model3D* drawn_model);
+    TPE_Vec3 get_triangle_normal(const S3L_Index* v, const S3L_Model3D* drawn_model);
+
+    /// Writes the normal of every triangle of `model` to `normals` (3 values per triangle).
+    void compute_triangle_normals(const S3L_Model3D* model, S3L_Unit* normals);
 }
 
 
@@ -254,16 +362,58 @@ namespace render {
             {  30,  31,  16,  17,  24,  25,  26,  27,  21,  15, 248, 249,   3,   4,   5,   6 }, // "▲▼►◄↑↓→←§☼°∙♥♦♣♠"
     };
 
+    inline constexpr std::size_t palette_count = std::size(color_grades) + 1;
+
+    /**
+     * The glyph drawn for every (palette, luminance) pair, so drawing never has to scale luminance.
+     * Full luminance maps to the last world color (the old scaling indexed past the end of the string).
+     */
+    inline constexpr auto glyph_table = [] {
+        std::array<std::array<char, 256>, palette_count> table {};
+        constexpr std::size_t world_max = sizeof(world_color) - 2;
+        for(std::size_t l = 0; l < 256; ++l) {
+            auto offset = static_cast<std::size_t>(double(l / 255.0) * sizeof(world_color));
+            table[0][l] = world_color[(offset > world_max) ? world_max : offset];
+            for(std::size_t color = 1; color < palette_count; ++color) {
+                table[color][l] = static_cast<char>(color_grades[color - 1][l / sizeof(ColorGrade)]);
+            }
+        }
+        return table;
+    }();
+
+    /// Raw data of the active buffer and its row length, refreshed by begin_frame().
+    inline char* frame_data = nullptr;
+    inline int frame_stride = 0;
+
     void initialize_screen(api::Coords screen_size) NOEXCEPT;
 
     void initialize_buffer(api::Framebuffer<char>& framebuffer) NOEXCEPT;
 
+    /**
+     * Caches the active buffer of internal_buffer<char>. Must be called whenever the
+     * active buffer may have changed (after post_buffer/swap_buffers), before drawing.
+     */
+    void begin_frame() NOEXCEPT;
+
     /**
      * Draws a pixel to the current screen buffer. Only supports ASCII color at the moment.
      * @param color The color gradient. 0 is used for the world color, all others are from color_grades.
      * @param luminance A value in the range [0, 255] (this will be scaled appropriately)
      */
-    void draw_pixel(int x, int y, uint8_t color, uint8_t luminance);
+    inline void draw_pixel(int x, int y, uint8_t color, uint8_t luminance) NOEXCEPT {
+        debug_assert(not (x < 0 or y < 0 or x > TRES_X or y > TRES_Y), "Invalid screen coordinates.");
+        debug_assert(color < palette_count, "Invalid palette.");
+        frame_data[x + (y * frame_stride)] = glyph_table[color][luminance];
+    }
+
+    /**
+     * Draws `length` pixels of the same color, starting at { x, y } and going right.
+     */
+    inline void draw_span(int x, int y, int length, uint8_t color, uint8_t luminance) NOEXCEPT {
+        debug_assert(not (x < 0 or y < 0 or x + length > TRES_X or y > TRES_Y), "Invalid screen coordinates.");
+        debug_assert(color < palette_count, "Invalid palette.");
+        std::memset(frame_data + x + (y * frame_stride), glyph_table[color][luminance], length);
+    }
 }
 
 #endif //PROJECT3_TEST_RENDER_CORE_HPP
@@ -0,0 +1,122 @@
+#ifndef PROJECT3_TEST_DEPTH_PYRAMID_HPP
+#define PROJECT3_TEST_DEPTH_PYRAMID_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <render/small3dlib.hpp>
+#include <config.hpp>
+
+namespace render {
+    /**
+     * Hierarchical-Z: a mip chain of the z-buffer where every texel holds the farthest
+     * depth under it. Anything whose nearest point lies behind all the texels its screen
+     * rectangle covers is completely hidden.
+     */
+    struct DepthPyramid {
+        /// Rectangles are tested against at most this many texels per axis.
+        static constexpr int max_footprint = 4;
+        /// Absorbs fixed point error in the rasterizer's depth.
+        static constexpr S3L_Unit depth_bias = S3L_FRACTIONS_PER_UNIT / 64;
+
+        /// Rebuilds the pyramid from what has been rasterized so far this frame.
+        void build() NOEXCEPT {
+            _level_count = 0;
+            int width = (S3L_RESOLUTION_X + 1) / 2;
+            int height = (S3L_RESOLUTION_Y + 1) / 2;
+            if(S3L_RESOLUTION_X <= 0 or S3L_RESOLUTION_Y <= 0) return;
+
+            /// The first level is already half resolution, reading the z-buffer dominates the cost
+            Level& base = _push_level(width, height);
+            for(int y = 0; y < height; ++y) {
+                for(int x = 0; x < width; ++x) {
+                    const int sx = x * 2, sy = y * 2;
+                    const int ex = std::min(sx + 2, int(S3L_RESOLUTION_X));
+                    const int ey = std::min(sy + 2, int(S3L_RESOLUTION_Y));
+                    S3L_Unit depth = 0;
+                    for(int py = sy; py < ey; ++py)
+                        for(int px = sx; px < ex; ++px)
+                            depth = std::max(depth, S3L_zBufferRead(px, py));
+                    base.depth[y * width + x] = depth;
+                }
+            }
+
+            while(width > 1 or height > 1) {
+                width = (width + 1) / 2;
+                height = (height + 1) / 2;
+                Level& dst = _push_level(width, height);
+                const Level& src = _levels[_level_count - 2];
+
+                for(int y = 0; y < height; ++y) {
+                    for(int x = 0; x < width; ++x) {
+                        const int sx = x * 2, sy = y * 2;
+                        const int ex = std::min(sx + 2, src.width);
+                        const int ey = std::min(sy + 2, src.height);
+                        S3L_Unit depth = 0;
+                        for(int py = sy; py < ey; ++py)
+                            for(int px = sx; px < ex; ++px)
+                                depth = std::max(depth, src.depth[py * src.width + px]);
+                        dst.depth[y * width + x] = depth;
+                    }
+                }
+            }
+        }
+
+        void clear() NOEXCEPT { _level_count = 0; }
+        NODISCARD bool empty() CNOEXCEPT { return _level_count == 0; }
+
+        /**
+         * Tests a screen rectangle (inclusive, in rasterizer pixels) whose nearest point is at `depth`.
+         * Rectangles that leave the screen are only tested on the part that's on it.
+         */
+        NODISCARD bool is_occluded(int x0, int y0, int x1, int y1, S3L_Unit depth) CNOEXCEPT {
+            if(empty()) return false;
+            x0 = std::max(x0, 0);
+            y0 = std::max(y0, 0);
+            x1 = std::min(x1, int(S3L_RESOLUTION_X) - 1);
+            y1 = std::min(y1, int(S3L_RESOLUTION_Y) - 1);
+            if(x0 > x1 or y0 > y1) return false;
+
+            /// Level 0 texels cover 2x2 pixels
+            int shift = 1;
+            std::size_t level = 0;
+            while(level + 1 < _level_count and
+                  ((x1 >> shift) - (x0 >> shift) >= max_footprint or (y1 >> shift) - (y0 >> shift) >= max_footprint)) {
+                ++level;
+                ++shift;
+            }
+
+            const Level& l = _levels[level];
+            const int tx1 = std::min(x1 >> shift, l.width - 1);
+            const int ty1 = std::min(y1 >> shift, l.height - 1);
+            for(int y = y0 >> shift; y <= ty1; ++y) {
+                for(int x = x0 >> shift; x <= tx1; ++x) {
+                    if(l.depth[y * l.width + x] + depth_bias >= depth) return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        struct Level {
+            int width = 0, height = 0;
+            std::vector<S3L_Unit> depth;
+        };
+
+        /// Levels are kept between frames, so their storage is only reallocated on resize.
+        Level& _push_level(int width, int height) NOEXCEPT {
+            if(_level_count == _levels.size()) _levels.emplace_back();
+            Level& level = _levels[_level_count++];
+            level.width = width;
+            level.height = height;
+            level.depth.resize(std::size_t(width) * height);
+            return level;
+        }
+
+    private:
+        std::vector<Level> _levels;
+        std::size_t _level_count = 0;
+    };
+}
+
+#endif //PROJECT3_TEST_DEPTH_PYRAMID_HPP
@@ -0,0 +1,123 @@
+#ifndef PROJECT3_TEST_DYNAMIC_RESOLUTION_HPP
+#define PROJECT3_TEST_DYNAMIC_RESOLUTION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <api/core.hpp>
+#include <config.hpp>
+
+namespace render {
+    /**
+     * Scales the 3D render resolution to keep frames within a time budget.
+     * Frames are rendered into a smaller buffer and upscaled into the character grid.
+     * The scale only drops after several slow frames in a row, and only rises after a much
+     * longer run of fast ones, so it doesn't oscillate around the budget.
+     */
+    struct DynamicResolution {
+        static constexpr double min_scale = 0.5;
+        static constexpr double scale_step = 1.0 / 16.0;
+        /// Fractions of the budget: above `lower_threshold` is a miss, below `raise_threshold` is headroom.
+        static constexpr double lower_threshold = 0.95;
+        static constexpr double raise_threshold = 0.7;
+        static constexpr int lower_after = 4;
+        static constexpr int raise_after = 45;
+
+        explicit DynamicResolution(double budget_ms) NOEXCEPT : _budget(budget_ms) {}
+
+        /**
+         * Feeds the time spent on the last frame, excluding any sleep.
+         * @return If the scale changed.
+         */
+        bool update(double frame_ms) NOEXCEPT {
+            _average = (_average > 0.0) ? (frame_ms * smoothing) + (_average * (1.0 - smoothing)) : frame_ms;
+            const double load = _average / _budget;
+
+            if(load > lower_threshold) {
+                _fast_frames = 0;
+                if(++_slow_frames < lower_after) return false;
+                /// Cost is roughly proportional to the area, aim just below the budget
+                const double wanted = _scale * std::sqrt(raise_threshold / load);
+                return _set_scale(std::min(_scale - scale_step, std::floor(wanted / scale_step) * scale_step));
+            }
+            _slow_frames = 0;
+
+            if(load < raise_threshold) {
+                if(++_fast_frames < raise_after) return false;
+                return _set_scale(_scale + scale_step);
+            }
+            _fast_frames = 0;
+            return false;
+        }
+
+        NODISCARD double get_scale() CNOEXCEPT { return _scale; }
+        NODISCARD bool is_scaled() CNOEXCEPT { return _scale < 1.0; }
+
+        /// The render resolution for a full resolution of `full` rasterizer pixels (two rows per cell).
+        NODISCARD api::Coords get_resolution(api::Coords full) CNOEXCEPT {
+            const int x = std::max(1, int(std::lround(full.x * _scale)));
+            const int rows = std::max(1, int(std::lround((full.y / 2) * _scale)));
+            return { x, rows * 2 };
+        }
+
+        /**
+         * Sizes the low resolution buffer for this frame and fills it with `empty`.
+         * @return Its data, with a row length of get_resolution(full).x.
+         */
+        char* begin_frame(api::Coords full, char empty) NOEXCEPT {
+            _full = full;
+            _size = get_resolution(full);
+            _buffer.assign(std::size_t(_size.x) * (_size.y / 2), empty);
+            return _buffer.data();
+        }
+
+        /**
+         * Copies the low resolution buffer over the cells of `dst` it covers, skipping `empty` cells.
+         * The buffer is emptied after, so calling this again only copies what was drawn since.
+         */
+        void upscale(char* dst, int dst_stride, char empty) NOEXCEPT {
+            const int columns = _full.x;
+            const int rows = _full.y / 2;
+            const int src_rows = _size.y / 2;
+
+            _column_map.resize(columns);
+            for(int x = 0; x < columns; ++x) _column_map[x] = x * _size.x / columns;
+
+            for(int y = 0; y < rows; ++y) {
+                const char* src = _buffer.data() + std::size_t(y * src_rows / rows) * _size.x;
+                char* out = dst + std::size_t(y) * dst_stride;
+                for(int x = 0; x < columns; ++x) {
+                    const char c = src[_column_map[x]];
+                    if(c != empty) out[x] = c;
+                }
+            }
+            std::fill(_buffer.begin(), _buffer.end(), empty);
+        }
+
+    private:
+        static constexpr double smoothing = 0.25;
+
+        bool _set_scale(double scale) NOEXCEPT {
+            scale = std::clamp(scale, min_scale, 1.0);
+            _slow_frames = _fast_frames = 0;
+            if(scale == _scale) return false;
+            /// Frames at the old scale say nothing about the new one
+            _scale = scale;
+            _average = 0.0;
+            return true;
+        }
+
+    private:
+        double _budget;
+        double _average = 0.0;
+        double _scale = 1.0;
+        int _slow_frames = 0, _fast_frames = 0;
+
+        api::Coords _full {}, _size {};
+        std::vector<char> _buffer;
+        std::vector<int> _column_map;
+    };
+}
+
+#endif //PROJECT3_TEST_DYNAMIC_RESOLUTION_HPP
@@ -2,6 +2,8 @@
 #define PROJECT3_TEST_HELPER_HPP
 
 #include <render/core.hpp>
+#include <render/dynamic_resolution.hpp>
+#include <render/render_context.hpp>
 #include <level_model.hpp>
 
 #ifndef HEIGHTMAP_3D_RESOLUTION
@@ -246,7 +248,13 @@ const S3L_Index cylinderTriangleIndices[CYLINDER_TRIANGLE_COUNT * 3] = {
 S3L_Model3D sphereModel;
 S3L_Model3D cylinderModel;
 
+S3L_Unit cubeNormals[S3L_CUBE_TRIANGLE_COUNT * 3];
+S3L_Unit planeNormals[2 * 3];
+S3L_Unit sphereNormals[SPHERE_TRIANGLE_COUNT * 3];
+S3L_Unit cylinderNormals[CYLINDER_TRIANGLE_COUNT * 3];
+
 TPE::ECS* tpe_ecs = nullptr;
+render::TileRasterizer* helper_rasterizer = nullptr;
 int helper_running;
 
 std::size_t helper_frame, helper_framev;
@@ -294,27 +302,74 @@ void helper_drawPoint3D(TPE_Vec3 p, uint8_t c, uint8_t l = 255)
 }
 
 uint8_t s3l_palette = 0, s3l_alpha = 255;
-uint8_t s3l_lum = 255;
 
-unsigned int s3l_previousTriangleID = 10000;
+/* The view the helper draws to: the models queued this frame, with their
+   palette and the luminance of every triangle (filled in once per draw so the
+   span function only has to do a lookup), the z-buffer and the occluders. */
+render::RenderContext helper_context;
+
+/* Lowers the 3D resolution while frames miss the DFPS budget, see
+   helper_frameTime. Everything else is still drawn at full resolution. */
+render::DynamicResolution helper_resolution(1000.0 / DFPS);
+
+/* 0 = off, 1 = half blocks, 2 = 2x4 blocks. Rasterizes several subpixels per
+   cell, and draws the edges of geometry with the block glyph matching their
+   coverage. */
+uint8_t helper_subcellMode = 0;
+render::SubcellBuffer helper_subcells;
 
-S3L_Model3D* _helper_drawnModel;
+char *_helper_target;
+int _helper_targetStride;
+uint8_t _helper_frameSubcellMode; // The mode at helper_frameStart
+size_t _helper_compositedCount;   // helper_context.drawn_count() when last composited
 
 TPE_Vec3 helper_lightDir;
 
-// TODO: FINISH
-inline void S3L_PIXEL_FUNCTION(S3L_PixelInfo *p) {
-    if (p->triangleIndex != s3l_previousTriangleID) {
-        const S3L_Index *v = _helper_drawnModel->triangles + 3 * p->triangleIndex;
-        TPE_Vec3 normal = TPE::get_triangle_normal(v, _helper_drawnModel);
+void helper_computeLighting(const S3L_Model3D *model, TPE_Vec3 rot, uint8_t *luminance)
+{
+    /* Rotate the light into model space (by the inverse of the model's
+       rotation), so it can be used with the model space normals directly. */
+    S3L_Mat4 m;
+    S3L_makeRotationMatrixZXY(rot.x,rot.y,rot.z,m);
+
+    TPE_Vec3 light;
+    light.x = (m[0][0] * helper_lightDir.x + m[1][0] * helper_lightDir.y + m[2][0] * helper_lightDir.z) / S3L_FRACTIONS_PER_UNIT;
+    light.y = (m[0][1] * helper_lightDir.x + m[1][1] * helper_lightDir.y + m[2][1] * helper_lightDir.z) / S3L_FRACTIONS_PER_UNIT;
+    light.z = (m[0][2] * helper_lightDir.x + m[1][2] * helper_lightDir.y + m[2][2] * helper_lightDir.z) / S3L_FRACTIONS_PER_UNIT;
 
-        TPE_Unit intensity = 128 + (TPE_vec3Dot(normal, helper_lightDir) / 4);
-        s3l_lum = intensity;
+    for (S3L_Index i = 0; i < model->triangleCount; ++i)
+    {
+        TPE_Vec3 normal;
+
+        if (model->triangleNormals)
+        {
+            const S3L_Unit *n = model->triangleNormals + 3 * i;
+            normal = TPE_vec3(n[0],n[1],n[2]);
+        }
+        else
+            normal = TPE::get_triangle_normal(model->triangles + 3 * i, model);
 
-        s3l_previousTriangleID = p->triangleIndex;
+        TPE_Unit intensity = 128 + (TPE_vec3Dot(normal, light) / 4);
+        luminance[i] = TPE_keepInRange(intensity,0,255);
     }
+}
+
+const S3L_Camera& helper_getCamera() {
+    return s3l_scene.camera;
+}
+
+/* The camera in the scaled down space models are rendered in. */
+S3L_Camera helper_renderCamera()
+{
+    S3L_Camera camera = s3l_scene.camera;
+
+#if SCALE_3D_RENDERING != 1
+    camera.transform.translation.x /= SCALE_3D_RENDERING;
+    camera.transform.translation.y /= SCALE_3D_RENDERING;
+    camera.transform.translation.z /= SCALE_3D_RENDERING;
+#endif
 
-    render::draw_pixel(p->x, p->y / 2, s3l_palette, s3l_lum);
+    return camera;
 }
 
 void helper_set3DColor(uint8_t p, uint8_t a) {
@@ -322,15 +377,39 @@ void helper_set3DColor(uint8_t p, uint8_t a) {
     s3l_alpha = a;
 }
 
-void helper_drawScene() {
+/* Writes what was drawn since the last call into the frame, so 2D drawn after
+   it ends up on top. */
+void _helper_composite3D()
+{
+    if (helper_context.drawn_count() == _helper_compositedCount)
+        return;
+
+    _helper_compositedCount = helper_context.drawn_count();
+
+    if (_helper_frameSubcellMode)
+        helper_subcells.resolve(_helper_target,_helper_targetStride);
 
+    if (helper_resolution.is_scaled())
+        helper_resolution.upscale(render::frame_data,render::frame_stride,(char)255);
 }
 
-void helper_drawModel(S3L_Model3D *model, TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot) {
-    _helper_drawnModel = model;
+/* Culls and rasterizes everything queued by helper_drawModel since the last
+   call, in one scene, and puts it in the frame. */
+void helper_drawScene()
+{
+    helper_context.draw_scene(helper_renderCamera());
+    _helper_composite3D();
+}
 
-    s3l_previousTriangleID = -1;
+/* Draws everything queued so far (meant for large occluders like the level) and
+   builds a depth pyramid from it. Models drawn after this in the same frame
+   are skipped if they're completely hidden behind what's already on screen. */
+void helper_drawOccluders()
+{
+    helper_context.draw_occluders(helper_renderCamera());
+}
 
+void helper_drawModel(S3L_Model3D *model, TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot) {
     model->transform.translation.x = pos.x;
     model->transform.translation.y = pos.y;
     model->transform.translation.z = pos.z;
@@ -343,41 +422,74 @@ void helper_drawModel(S3L_Model3D *model, TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3
     model->transform.rotation.y = rot.y;
     model->transform.rotation.z = rot.z;
 
-    s3l_scene.models = model;
+    S3L_Model3D queued = *model;
 
 #if SCALE_3D_RENDERING != 1
+    queued.transform.scale.x /= SCALE_3D_RENDERING;
+    queued.transform.scale.y /= SCALE_3D_RENDERING;
+    queued.transform.scale.z /= SCALE_3D_RENDERING;
 
-    S3L_Vec4 cp = s3l_scene.camera.transform.translation;
-  S3L_Vec4 ms = s3l_scene.models[0].transform.scale;
-  S3L_Vec4 mp = s3l_scene.models[0].transform.translation;
+    queued.transform.translation.x /= SCALE_3D_RENDERING;
+    queued.transform.translation.y /= SCALE_3D_RENDERING;
+    queued.transform.translation.z /= SCALE_3D_RENDERING;
+#endif
 
-  s3l_scene.camera.transform.translation.x /= SCALE_3D_RENDERING;
-  s3l_scene.camera.transform.translation.y /= SCALE_3D_RENDERING;
-  s3l_scene.camera.transform.translation.z /= SCALE_3D_RENDERING;
+    uint8_t *luminance = helper_context.push(queued,helper_renderCamera(),s3l_palette);
 
-  s3l_scene.models[0].transform.scale.x /= SCALE_3D_RENDERING;
-  s3l_scene.models[0].transform.scale.y /= SCALE_3D_RENDERING;
-  s3l_scene.models[0].transform.scale.z /= SCALE_3D_RENDERING;
+    if (luminance)
+        helper_computeLighting(model,rot,luminance);
+}
 
-  s3l_scene.models[0].transform.translation.x /= SCALE_3D_RENDERING;
-  s3l_scene.models[0].transform.translation.y /= SCALE_3D_RENDERING;
-  s3l_scene.models[0].transform.translation.z /= SCALE_3D_RENDERING;
+typedef struct
+{
+    TPE_Vec3 pos;
+    TPE_Vec3 scale;
+    TPE_Vec3 rot;
+} helper_Instance;
 
-#endif
+std::vector<S3L_Transform3D> _helper_instanceTransforms;
 
-    S3L_drawScene(s3l_scene);
+/* Draws one copy of the model per instance. Culling, camera setup and lighting
+   are shared by the whole batch, instead of being redone for every copy like
+   with repeated helper_drawModel calls. */
+void helper_drawModelInstanced(S3L_Model3D *model, std::span<const helper_Instance> instances)
+{
+    if (instances.empty())
+        return;
 
-#if SCALE_3D_RENDERING != 1
+    _helper_instanceTransforms.resize(instances.size());
 
-    s3l_scene.camera.transform.translation = cp;
-  s3l_scene.models[0].transform.scale = ms;
-  s3l_scene.models[0].transform.translation = mp;
+    for (std::size_t i = 0; i < instances.size(); ++i)
+    {
+        const helper_Instance *in = &instances[i];
+        S3L_Transform3D *t = &_helper_instanceTransforms[i];
+
+        S3L_transform3DInit(t);
+        t->translation.x = in->pos.x / SCALE_3D_RENDERING;
+        t->translation.y = in->pos.y / SCALE_3D_RENDERING;
+        t->translation.z = in->pos.z / SCALE_3D_RENDERING;
+        t->scale.x = in->scale.x / SCALE_3D_RENDERING;
+        t->scale.y = in->scale.y / SCALE_3D_RENDERING;
+        t->scale.z = in->scale.z / SCALE_3D_RENDERING;
+        t->rotation.x = in->rot.x;
+        t->rotation.y = in->rot.y;
+        t->rotation.z = in->rot.z;
+    }
 
-#endif
+    helper_context.push_instances(*model,_helper_instanceTransforms,helper_renderCamera(),s3l_palette,
+        [model](const S3L_Transform3D &t, uint8_t *luminance)
+        {
+            helper_computeLighting(model,TPE_vec3(t.rotation.x,t.rotation.y,t.rotation.z),luminance);
+        });
 }
 
 void helper_draw3DTriangle(TPE_Vec3 v1, TPE_Vec3 v2, TPE_Vec3 v3)
 {
+    /* The vertices are shared by every draw of triangleModel, so anything still
+       queued has to be drawn before they are overwritten. */
+    helper_drawScene();
+    helper_context.get_queue().invalidate_bounds(triangleVertices);
+
     triangleVertices[0] = v1.x;
     triangleVertices[1] = v1.y;
     triangleVertices[2] = v1.z;
@@ -391,6 +503,7 @@ void helper_draw3DTriangle(TPE_Vec3 v1, TPE_Vec3 v2, TPE_Vec3 v3)
     helper_drawModel(&triangleModel,TPE_vec3(0,0,0),
                      TPE_vec3(S3L_FRACTIONS_PER_UNIT,S3L_FRACTIONS_PER_UNIT,S3L_FRACTIONS_PER_UNIT),
                      TPE_vec3(0,0,0));
+    helper_drawScene();
 }
 
 void helper_draw3DBox(TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot)
@@ -421,6 +534,18 @@ void helper_draw3DSphere(TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot)
     helper_drawModel(&sphereModel,pos,scale,rot);
 }
 
+void helper_draw3DBoxInstanced(std::span<const helper_Instance> instances)
+{
+    cubeModel.config.backfaceCulling = 2;
+    helper_drawModelInstanced(&cubeModel,instances);
+}
+
+void helper_draw3DSphereInstanced(std::span<const helper_Instance> instances)
+{
+    sphereModel.config.backfaceCulling = 2;
+    helper_drawModelInstanced(&sphereModel,instances);
+}
+
 void helper_draw3DSphereInside(TPE_Vec3 pos, TPE_Vec3 scale, TPE_Vec3 rot)
 {
     sphereModel.config.backfaceCulling = 1;
@@ -445,10 +570,8 @@ void tpe_debugDrawPixel(uint16_t x, uint16_t y, uint8_t color)
             default: p = 4; l = 0;   break;
         }
 
-        for (int i = 0; i < 3; ++i) {
-            render::draw_pixel(x + i, (y / 2) + 0, p, l);
-            render::draw_pixel(x + i, (y / 2) + 1, p, l);
-        }
+        render::draw_span(x, (y / 2) + 0, 3, p, l);
+        render::draw_span(x, (y / 2) + 1, 3, p, l);
     }
 }
 
@@ -495,21 +618,71 @@ void helper_init()
 
     S3L_model3DInit(triangleVertices,3,triangleTriangles,2,&triangleModel);
 
+    TPE::compute_triangle_normals(&cubeModel,cubeNormals);
+    TPE::compute_triangle_normals(&planeModel,planeNormals);
+    TPE::compute_triangle_normals(&sphereModel,sphereNormals);
+    TPE::compute_triangle_normals(&cylinderModel,cylinderNormals);
+
+    cubeModel.triangleNormals = cubeNormals;
+    planeModel.triangleNormals = planeNormals;
+    sphereModel.triangleNormals = sphereNormals;
+    cylinderModel.triangleNormals = cylinderNormals;
+
     S3L_sceneInit(0,1,&s3l_scene);
 
     tpe_ecs = new TPE::ECS();
+    helper_rasterizer = new render::TileRasterizer();
+    helper_context.set_rasterizer(helper_rasterizer);
 }
 
 void helper_frameStart()
 {
     render::internal_buffer<char>->get_active_buffer()->set_buffer_data(255);
-    S3L_newFrame();
+    render::begin_frame();
+
+    api::Coords resolution = render::screen_coords;
+    _helper_target = render::frame_data;
+    _helper_targetStride = render::frame_stride;
+
+    if (helper_resolution.is_scaled())
+    {
+        resolution = helper_resolution.get_resolution(render::screen_coords);
+        _helper_target = helper_resolution.begin_frame(render::screen_coords,(char)255);
+        _helper_targetStride = resolution.x;
+    }
+
+    _helper_frameSubcellMode = helper_subcellMode;
+
+    if (_helper_frameSubcellMode)
+    {
+        render::SubcellMode mode = (_helper_frameSubcellMode == 1) ?
+            render::SubcellMode::half_block : render::SubcellMode::block_2x4;
+        api::Coords cells = { resolution.x, resolution.y / 2 };
+
+        helper_subcells.begin(cells,mode);
+        resolution = render::SubcellBuffer::get_resolution(cells,mode);
+    }
+
+    helper_context.set_subcells(_helper_frameSubcellMode ? &helper_subcells : nullptr);
+    helper_context.set_target(_helper_target,_helper_targetStride,resolution);
+
+    helper_context.begin_frame();
+    _helper_compositedCount = 0;
     S3L_rotationToDirections(s3l_scene.camera.transform.rotation,
                              CAMERA_STEP,&helper_cameraForw,&helper_cameraRight,&helper_cameraUp);
 }
 
+/* Reports how long the frame took without any sleeping, for the dynamic
+   resolution. */
+void helper_frameTime(double ms)
+{
+    helper_resolution.update(ms);
+}
+
 void helper_frameEnd()
 {
+    helper_drawScene();
+
     render::internal_buffer<char>->post_buffer();
     render::internal_buffer<char>->swap_buffers();
     ++helper_frame;
@@ -0,0 +1,355 @@
+#include "mesh_simplify.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <queue>
+
+namespace render {
+    namespace {
+        /// Levels must drop at least this share of triangles to be worth keeping.
+        constexpr double min_reduction = 0.2;
+        /// Open edges are held in place by planes this much stiffer than the surface.
+        constexpr double boundary_weight = 100.0;
+
+        using Vec3 = std::array<double, 3>;
+
+        inline Vec3 sub(const Vec3& a, const Vec3& b) {
+            return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+        }
+
+        inline Vec3 cross(const Vec3& a, const Vec3& b) {
+            return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        }
+
+        inline double dot(const Vec3& a, const Vec3& b) {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        /**
+         * Sum of squared distances to a set of planes, as a symmetric 4x4 matrix.
+         * Stored as the upper triangle: xx xy xz xw yy yz yw zz zw ww.
+         */
+        struct Quadric {
+            double m[10] {};
+
+            static Quadric from_plane(const Vec3& n, double d, double weight) {
+                Quadric q;
+                const double p[4] { n[0], n[1], n[2], d };
+                int k = 0;
+                for(int i = 0; i < 4; ++i)
+                    for(int j = i; j < 4; ++j)
+                        q.m[k++] = weight * p[i] * p[j];
+                return q;
+            }
+
+            Quadric& operator+=(const Quadric& rhs) {
+                for(int i = 0; i < 10; ++i) m[i] += rhs.m[i];
+                return *this;
+            }
+
+            NODISCARD double evaluate(const Vec3& v) const {
+                const double x = v[0], y = v[1], z = v[2];
+                return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+                     + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+                     + m[7] * z * z + 2 * m[8] * z
+                     + m[9];
+            }
+
+            /// The point minimizing the error, if the quadric isn't degenerate.
+            bool minimum(Vec3& out) const {
+                const double a = m[0], b = m[1], c = m[2];
+                const double e = m[4], f = m[5], i = m[7];
+                const double det = a * (e * i - f * f) - b * (b * i - f * c) + c * (b * f - e * c);
+                if(std::abs(det) < 1e-12) return false;
+
+                const double r[3] { -m[3], -m[6], -m[8] };
+                out[0] = (r[0] * (e * i - f * f) - b * (r[1] * i - f * r[2]) + c * (r[1] * f - e * r[2])) / det;
+                out[1] = (a * (r[1] * i - f * r[2]) - r[0] * (b * i - f * c) + c * (b * r[2] - r[1] * c)) / det;
+                out[2] = (a * (e * r[2] - r[1] * f) - b * (b * r[2] - r[1] * c) + r[0] * (b * f - e * c)) / det;
+                return true;
+            }
+        };
+
+        struct Collapse {
+            double cost;
+            std::uint32_t keep, remove;
+            std::uint32_t keep_version, remove_version;
+            Vec3 target;
+
+            bool operator>(const Collapse& rhs) const { return cost > rhs.cost; }
+        };
+
+        /**
+         * Garland-Heckbert edge collapse, run in place so that snapshots can be taken
+         * at every level of the chain.
+         */
+        struct Simplifier {
+            Simplifier(std::span<const S3L_Unit> vertices, std::span<const S3L_Index> faces) {
+                const std::size_t vertex_count = vertices.size() / 3;
+                _positions.resize(vertex_count);
+                _quadrics.resize(vertex_count);
+                _vertex_faces.resize(vertex_count);
+                _versions.resize(vertex_count, 0);
+                _alive.resize(vertex_count, true);
+
+                for(std::size_t v = 0; v < vertex_count; ++v) {
+                    for(int axis = 0; axis < 3; ++axis) _positions[v][axis] = double(vertices[v * 3 + axis]);
+                }
+
+                _faces.reserve(faces.size() / 3);
+                for(std::size_t f = 0; f < faces.size(); f += 3) {
+                    const std::array<std::uint32_t, 3> face { faces[f], faces[f + 1], faces[f + 2] };
+                    if(face[0] == face[1] or face[1] == face[2] or face[0] == face[2]) continue;
+                    const auto index = static_cast<std::uint32_t>(_faces.size());
+                    _faces.push_back(face);
+                    _face_alive.push_back(true);
+                    for(std::uint32_t v : face) _vertex_faces[v].push_back(index);
+                }
+                _live_faces = _faces.size();
+
+                _init_quadrics();
+                for(std::uint32_t v = 0; v < vertex_count; ++v) _push_edges(v);
+            }
+
+            NODISCARD std::size_t face_count() const { return _live_faces; }
+            NODISCARD double error() const { return _error; }
+
+            /// Collapses the cheapest edges until at most `target` triangles are left.
+            void reduce_to(std::size_t target) {
+                while(_live_faces > target and not _heap.empty()) {
+                    const Collapse collapse = _heap.top();
+                    _heap.pop();
+                    if(not _alive[collapse.keep] or not _alive[collapse.remove]) continue;
+                    if(_versions[collapse.keep] != collapse.keep_version or
+                       _versions[collapse.remove] != collapse.remove_version) continue;
+                    if(not _is_valid(collapse)) continue;
+                    _apply(collapse);
+                }
+            }
+
+            NODISCARD SimplifiedMesh extract() const {
+                SimplifiedMesh mesh;
+                mesh.error = _error;
+
+                std::vector<S3L_Index> remap(_positions.size(), S3L_Index(-1));
+                for(std::size_t f = 0; f < _faces.size(); ++f) {
+                    if(not _face_alive[f]) continue;
+                    for(std::uint32_t v : _faces[f]) {
+                        if(remap[v] == S3L_Index(-1)) {
+                            remap[v] = static_cast<S3L_Index>(mesh.vertices.size() / 3);
+                            for(double coord : _positions[v]) mesh.vertices.push_back(S3L_Unit(std::llround(coord)));
+                        }
+                        mesh.faces.push_back(remap[v]);
+                    }
+                }
+                return mesh;
+            }
+
+        private:
+            void _init_quadrics() {
+                /// Edges used by a single face are open, count them first
+                std::vector<std::pair<std::uint64_t, std::uint32_t>> edges;
+                edges.reserve(_faces.size() * 3);
+                for(std::uint32_t f = 0; f < _faces.size(); ++f) {
+                    const auto& face = _faces[f];
+                    const Vec3 normal = cross(sub(_positions[face[1]], _positions[face[0]]),
+                                              sub(_positions[face[2]], _positions[face[0]]));
+                    const double length = std::sqrt(dot(normal, normal));
+                    if(length <= 0.0) continue;
+
+                    const Vec3 n { normal[0] / length, normal[1] / length, normal[2] / length };
+                    const Quadric q = Quadric::from_plane(n, -dot(n, _positions[face[0]]), 1.0);
+                    for(std::uint32_t v : face) _quadrics[v] += q;
+
+                    for(int i = 0; i < 3; ++i) {
+                        const std::uint32_t a = face[i], b = face[(i + 1) % 3];
+                        edges.emplace_back((std::uint64_t(std::min(a, b)) << 32) | std::max(a, b), f);
+                    }
+                }
+
+                std::sort(edges.begin(), edges.end());
+                for(std::size_t i = 0; i < edges.size();) {
+                    std::size_t j = i + 1;
+                    while(j < edges.size() and edges[j].first == edges[i].first) ++j;
+                    if(j - i == 1) _add_boundary(edges[i].first, edges[i].second);
+                    i = j;
+                }
+            }
+
+            /// Plane through the edge, perpendicular to its face.
+            void _add_boundary(std::uint64_t edge, std::uint32_t face_index) {
+                const auto a = static_cast<std::uint32_t>(edge >> 32);
+                const auto b = static_cast<std::uint32_t>(edge & 0xFFFFFFFF);
+                const auto& face = _faces[face_index];
+
+                const Vec3 direction = sub(_positions[b], _positions[a]);
+                const Vec3 face_normal = cross(sub(_positions[face[1]], _positions[face[0]]),
+                                               sub(_positions[face[2]], _positions[face[0]]));
+                const Vec3 normal = cross(direction, face_normal);
+                const double length = std::sqrt(dot(normal, normal));
+                if(length <= 0.0) return;
+
+                const Vec3 n { normal[0] / length, normal[1] / length, normal[2] / length };
+                const Quadric q = Quadric::from_plane(n, -dot(n, _positions[a]), boundary_weight);
+                _quadrics[a] += q;
+                _quadrics[b] += q;
+            }
+
+            void _push_edges(std::uint32_t v) {
+                for(std::uint32_t f : _vertex_faces[v]) {
+                    if(not _face_alive[f]) continue;
+                    for(std::uint32_t other : _faces[f]) {
+                        /// Every edge is reachable from both ends, only queue it once
+                        if(other > v) _push_edge(v, other);
+                    }
+                }
+            }
+
+            void _push_edge(std::uint32_t a, std::uint32_t b) {
+                Quadric q = _quadrics[a];
+                q += _quadrics[b];
+
+                Collapse collapse;
+                collapse.keep = a;
+                collapse.remove = b;
+                collapse.keep_version = _versions[a];
+                collapse.remove_version = _versions[b];
+
+                if(not q.minimum(collapse.target)) {
+                    const Vec3& pa = _positions[a];
+                    const Vec3& pb = _positions[b];
+                    const Vec3 mid { (pa[0] + pb[0]) / 2, (pa[1] + pb[1]) / 2, (pa[2] + pb[2]) / 2 };
+                    collapse.target = pa;
+                    for(const Vec3& candidate : { pb, mid }) {
+                        if(q.evaluate(candidate) < q.evaluate(collapse.target)) collapse.target = candidate;
+                    }
+                }
+
+                collapse.cost = std::max(0.0, q.evaluate(collapse.target));
+                _heap.push(collapse);
+            }
+
+            /**
+             * Rejects collapses that would flip a triangle or make the mesh non-manifold
+             * (the endpoints share neighbours other than the ones across the edge).
+             */
+            NODISCARD bool _is_valid(const Collapse& collapse) {
+                const std::uint32_t ends[2] { collapse.keep, collapse.remove };
+                std::size_t edge_faces = 0;
+                _neighbours[0].clear();
+                _neighbours[1].clear();
+
+                for(int side = 0; side < 2; ++side) {
+                    const std::uint32_t v = ends[side];
+                    for(std::uint32_t f : _vertex_faces[v]) {
+                        if(not _face_alive[f]) continue;
+                        const auto& face = _faces[f];
+                        const bool shared = std::find(face.begin(), face.end(), ends[side ^ 1]) != face.end();
+                        if(shared) {
+                            edge_faces += (side == 0);
+                            continue;
+                        }
+
+                        for(std::uint32_t other : face) {
+                            if(other != v) _neighbours[side].push_back(other);
+                        }
+
+                        /// The face after moving v to the target must face the same way
+                        Vec3 corners[3];
+                        for(int i = 0; i < 3; ++i) corners[i] = (face[i] == v) ? collapse.target : _positions[face[i]];
+                        const Vec3 before = cross(sub(_positions[face[1]], _positions[face[0]]),
+                                                  sub(_positions[face[2]], _positions[face[0]]));
+                        const Vec3 after = cross(sub(corners[1], corners[0]), sub(corners[2], corners[0]));
+                        if(dot(before, after) <= 0.0) return false;
+                    }
+                }
+
+                for(auto& neighbours : _neighbours) {
+                    std::sort(neighbours.begin(), neighbours.end());
+                    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+                }
+
+                std::size_t common = 0;
+                auto it = _neighbours[1].begin();
+                for(std::uint32_t v : _neighbours[0]) {
+                    while(it != _neighbours[1].end() and *it < v) ++it;
+                    if(it != _neighbours[1].end() and *it == v) ++common;
+                }
+
+                /// The third corners of the edge's faces are always shared, anything else pinches the surface
+                return edge_faces > 0 and common <= edge_faces;
+            }
+
+            void _apply(const Collapse& collapse) {
+                const std::uint32_t keep = collapse.keep, remove = collapse.remove;
+
+                for(std::uint32_t f : _vertex_faces[remove]) {
+                    if(not _face_alive[f]) continue;
+                    auto& face = _faces[f];
+                    if(std::find(face.begin(), face.end(), keep) != face.end()) {
+                        _face_alive[f] = false;
+                        --_live_faces;
+                        continue;
+                    }
+                    std::replace(face.begin(), face.end(), remove, keep);
+                    _vertex_faces[keep].push_back(f);
+                }
+
+                auto& keep_faces = _vertex_faces[keep];
+                keep_faces.erase(std::remove_if(keep_faces.begin(), keep_faces.end(),
+                                                [this](std::uint32_t f) { return not _face_alive[f]; }),
+                                 keep_faces.end());
+                _vertex_faces[remove].clear();
+                _vertex_faces[remove].shrink_to_fit();
+
+                _positions[keep] = collapse.target;
+                _quadrics[keep] += _quadrics[remove];
+                _alive[remove] = false;
+                ++_versions[keep];
+                _error = std::max(_error, std::sqrt(collapse.cost));
+
+                /// Edges around the kept vertex changed cost, queue them again
+                for(std::uint32_t f : keep_faces) {
+                    for(std::uint32_t other : _faces[f]) {
+                        if(other != keep) _push_edge(keep, other);
+                    }
+                }
+            }
+
+        private:
+            std::vector<Vec3> _positions;
+            std::vector<Quadric> _quadrics;
+            std::vector<std::array<std::uint32_t, 3>> _faces;
+            std::vector<bool> _face_alive;
+            std::vector<std::vector<std::uint32_t>> _vertex_faces;
+            std::vector<std::uint32_t> _versions;      // Bumped whenever a vertex moves, stale collapses are skipped
+            std::vector<bool> _alive;
+            std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> _heap;
+            std::vector<std::uint32_t> _neighbours[2];
+            std::size_t _live_faces = 0;
+            double _error = 0.0;
+        };
+    }
+
+    std::vector<SimplifiedMesh> build_lod_chain(std::span<const S3L_Unit> vertices,
+                                                std::span<const S3L_Index> faces,
+                                                std::size_t max_levels, double ratio) {
+        std::vector<SimplifiedMesh> levels;
+        if(not max_levels or faces.size() < 3 or vertices.size() < 9) return levels;
+
+        Simplifier simplifier { vertices, faces };
+        std::size_t previous = simplifier.face_count();
+        while(levels.size() < max_levels) {
+            const auto target = static_cast<std::size_t>(double(previous) * ratio);
+            if(target < 1) break;
+
+            simplifier.reduce_to(target);
+            const std::size_t reached = simplifier.face_count();
+            if(reached == 0 or double(reached) > double(previous) * (1.0 - min_reduction)) break;
+
+            levels.push_back(simplifier.extract());
+            previous = reached;
+        }
+        return levels;
+    }
+}
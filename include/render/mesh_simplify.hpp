@@ -0,0 +1,31 @@
+#ifndef PROJECT3_TEST_MESH_SIMPLIFY_HPP
+#define PROJECT3_TEST_MESH_SIMPLIFY_HPP
+
+#include <span>
+#include <vector>
+
+#include <render/small3dlib.hpp>
+#include <api/core.hpp>
+
+namespace render {
+    /**
+     * One level of detail, in the same layout as ObjMesh.
+     */
+    struct SimplifiedMesh {
+        std::vector<S3L_Unit> vertices;     // 3 values per vertex
+        std::vector<S3L_Index> faces;       // 3 indices per triangle
+        double error = 0.0;                 // Upper bound of the distance to the source surface, in model units
+    };
+
+    /**
+     * Builds successively coarser versions of a mesh with quadric error metric edge collapses.
+     * Every level aims for `ratio` times the triangles of the one before. The chain stops early
+     * once collapses would fold triangles over or no longer reduce the mesh meaningfully.
+     * All levels are simplified from the source, so their errors are measured against it.
+     */
+    std::vector<SimplifiedMesh> build_lod_chain(std::span<const S3L_Unit> vertices,
+                                                std::span<const S3L_Index> faces,
+                                                std::size_t max_levels, double ratio = 0.5);
+}
+
+#endif //PROJECT3_TEST_MESH_SIMPLIFY_HPP
@@ -0,0 +1,211 @@
+#include "obj_loader.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <api/mapped_file.hpp>
+#include <api/detail/worker_pool.hpp>
+
+namespace render {
+    namespace {
+        /// Files smaller than this aren't worth splitting across threads.
+        constexpr std::size_t min_chunk_size = 1 << 20;
+
+        struct Chunk {
+            Chunk(const char* first, const char* last) : begin(first), end(last) {}
+
+            const char* begin;
+            const char* end;
+            std::size_t vertex_lines = 0;
+            std::size_t face_lines = 0;
+            std::size_t vertex_base = 0;    // Vertices in all earlier chunks
+
+            std::string name;
+            std::vector<S3L_Unit> vertices;
+            std::vector<S3L_Index> faces;
+            bool valid = true;
+        };
+
+        inline bool is_blank(char c) {
+            return c == ' ' or c == '\t' or c == '\r';
+        }
+
+        inline const char* skip_blank(const char* p, const char* end) {
+            while(p < end and is_blank(*p)) ++p;
+            return p;
+        }
+
+        inline const char* line_end(const char* p, const char* end) {
+            const auto* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            return nl ? nl : end;
+        }
+
+        /// Statement keyword of a line, without leading blanks.
+        inline std::string_view keyword(const char* p, const char* end) {
+            const char* begin = p;
+            while(p < end and not is_blank(*p)) ++p;
+            return { begin, static_cast<std::size_t>(p - begin) };
+        }
+
+        void count_lines(Chunk& chunk) {
+            for(const char* p = chunk.begin; p < chunk.end;) {
+                const char* eol = line_end(p, chunk.end);
+                const std::string_view key = keyword(skip_blank(p, eol), eol);
+                chunk.vertex_lines += (key == "v");
+                chunk.face_lines += (key == "f");
+                p = eol + 1;
+            }
+        }
+
+        bool parse_vertex(const char* p, const char* end, std::vector<S3L_Unit>& out) {
+            S3L_Unit values[3];
+            for(S3L_Unit& value : values) {
+                p = skip_blank(p, end);
+                double coord;
+                auto [next, ec] = std::from_chars(p, end, coord);
+                if(ec != std::errc{}) return false;
+                value = S3L_Unit(coord * S3L_FRACTIONS_PER_UNIT);
+                p = next;
+            }
+            out.insert(out.end(), values, values + 3);
+            return true;
+        }
+
+        /**
+         * Parses "f a b c ...", where each corner may be "v", "v/t", "v//n" or "v/t/n",
+         * and indices may be negative (relative to the vertices read so far).
+         */
+        bool parse_face(const char* p, const char* end, std::size_t vertex_count,
+                        bool flip, std::vector<S3L_Index>& out) {
+            S3L_Index first = 0, previous = 0;
+            int corners = 0;
+
+            while((p = skip_blank(p, end)) < end) {
+                long long index;
+                auto [next, ec] = std::from_chars(p, end, index);
+                if(ec != std::errc{}) return false;
+
+                const long long resolved = (index < 0) ? (long long)vertex_count + index : index - 1;
+                /// Anything S3L_Index can't hold would alias a valid vertex after the cast
+                if(resolved < 0 or resolved > std::numeric_limits<S3L_Index>::max()) return false;
+                const auto corner = static_cast<S3L_Index>(resolved);
+
+                /// Skip texture/normal indices
+                p = next;
+                while(p < end and not is_blank(*p)) ++p;
+
+                if(corners == 0) first = corner;
+                else if(corners >= 2) {
+                    const S3L_Index triangle[3] { first, previous, corner };
+                    if(flip) out.insert(out.end(), { triangle[2], triangle[1], triangle[0] });
+                    else out.insert(out.end(), triangle, triangle + 3);
+                }
+
+                previous = corner;
+                ++corners;
+            }
+
+            return corners >= 3;
+        }
+
+        void parse_chunk(Chunk& chunk, bool flip) {
+            chunk.vertices.reserve(chunk.vertex_lines * 3);
+            chunk.faces.reserve(chunk.face_lines * 3);
+
+            for(const char* p = chunk.begin; p < chunk.end;) {
+                const char* eol = line_end(p, chunk.end);
+                const char* start = skip_blank(p, eol);
+                const std::string_view key = keyword(start, eol);
+                const char* args = start + key.size();
+
+                if(key == "v") {
+                    /// Keep vertex numbering intact, a bad vertex still takes up an index
+                    if(not parse_vertex(args, eol, chunk.vertices)) {
+                        chunk.vertices.insert(chunk.vertices.end(), 3, 0);
+                    }
+                }
+                else if(key == "f") {
+                    const std::size_t vertex_count = chunk.vertex_base + (chunk.vertices.size() / 3);
+                    if(not parse_face(args, eol, vertex_count, flip, chunk.faces)) chunk.valid = false;
+                }
+                else if(key == "o" and chunk.name.empty()) {
+                    const char* name_begin = skip_blank(args, eol);
+                    const char* name_end = eol;
+                    while(name_end > name_begin and is_blank(name_end[-1])) --name_end;
+                    chunk.name.assign(name_begin, name_end);
+                }
+
+                p = eol + 1;
+            }
+        }
+
+        /// Splits the file into about `count` ranges of whole lines.
+        std::vector<Chunk> split_lines(const char* begin, const char* end, std::size_t count) {
+            std::vector<Chunk> chunks;
+            const auto size = static_cast<std::size_t>(end - begin);
+            const std::size_t step = (size + count - 1) / count;
+
+            for(const char* p = begin; p < end;) {
+                const char* split = (static_cast<std::size_t>(end - p) > step) ? line_end(p + step, end) : end;
+                if(split < end) ++split;
+                chunks.emplace_back(p, split);
+                p = split;
+            }
+            return chunks;
+        }
+    }
+
+    bool load_obj(const fs::path& filepath, ObjMesh& mesh, bool flip_winding) {
+        api::MappedFile file;
+        if(not file.open(filepath)) return false;
+
+        const auto* begin = reinterpret_cast<const char*>(file.data().data());
+        const auto* end = begin + file.size();
+
+        const std::size_t chunk_count = std::clamp<std::size_t>(file.size() / min_chunk_size, 1,
+                                                                api::WorkerPool::default_worker_count() + 1);
+        std::vector<Chunk> chunks = split_lines(begin, end, chunk_count);
+
+        auto parse_all = [&](auto&& run) {
+            if(chunks.size() == 1) {
+                run(0);
+                return;
+            }
+            api::WorkerPool pool { static_cast<unsigned>(chunks.size() - 1) };
+            pool.parallel_for(static_cast<int>(chunks.size()), [&](int i) { run(i); });
+        };
+
+        /// Counting first lets every chunk resolve relative indices and reserve exactly
+        parse_all([&](int i) { count_lines(chunks[i]); });
+        std::size_t vertex_lines = 0, face_lines = 0;
+        for(Chunk& chunk : chunks) {
+            chunk.vertex_base = vertex_lines;
+            vertex_lines += chunk.vertex_lines;
+            face_lines += chunk.face_lines;
+        }
+        parse_all([&](int i) { parse_chunk(chunks[i], flip_winding); });
+
+        mesh.name.clear();
+        mesh.vertices.clear();
+        mesh.faces.clear();
+        mesh.vertices.reserve(vertex_lines * 3);
+        mesh.faces.reserve(face_lines * 3);
+
+        bool valid = true;
+        for(Chunk& chunk : chunks) {
+            valid = valid and chunk.valid;
+            if(mesh.name.empty()) mesh.name = std::move(chunk.name);
+            mesh.vertices.insert(mesh.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+            mesh.faces.insert(mesh.faces.end(), chunk.faces.begin(), chunk.faces.end());
+        }
+
+        const std::size_t vertex_count = mesh.vertices.size() / 3;
+        const bool in_range = std::all_of(mesh.faces.begin(), mesh.faces.end(),
+                                          [&](S3L_Index index) { return index < vertex_count; });
+        if(not valid or not in_range) {
+            debug_printf("load_obj(): %s has invalid faces.", filepath.string().c_str());
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef PROJECT3_TEST_OBJ_LOADER_HPP
+#define PROJECT3_TEST_OBJ_LOADER_HPP
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <render/small3dlib.hpp>
+#include <api/core.hpp>
+
+namespace fs = std::filesystem;
+
+namespace render {
+    /**
+     * Geometry of a Wavefront .obj file, in S3L fixed point.
+     */
+    struct ObjMesh {
+        std::string name;
+        std::vector<S3L_Unit> vertices;     // 3 values per vertex
+        std::vector<S3L_Index> faces;       // 3 indices per triangle
+    };
+
+    /**
+     * Loads the positions and faces of an .obj file. Polygons are triangulated as fans,
+     * texture/normal indices and every other statement are skipped.
+     * Large files are parsed on multiple threads.
+     * @param flip_winding Reverses the order of every triangle.
+     * @return false if the file can't be read or a face references a missing vertex.
+     */
+    bool load_obj(const fs::path& filepath, ObjMesh& mesh, bool flip_winding = false);
+}
+
+#endif //PROJECT3_TEST_OBJ_LOADER_HPP
@@ -0,0 +1,170 @@
+#ifndef PROJECT3_TEST_RENDER_CONTEXT_HPP
+#define PROJECT3_TEST_RENDER_CONTEXT_HPP
+
+#include <span>
+
+#include <render/core.hpp>
+#include <render/depth_pyramid.hpp>
+#include <render/render_queue.hpp>
+#include <render/subcell_buffer.hpp>
+#include <render/tile_rasterizer.hpp>
+
+namespace render {
+    /**
+     * Points S3L_context of the calling thread at `context` until destroyed.
+     */
+    struct ContextBinding {
+        explicit ContextBinding(S3L_Context* context) NOEXCEPT : _previous(S3L_context) { S3L_context = context; }
+        ~ContextBinding() { S3L_context = _previous; }
+
+        ContextBinding(const ContextBinding&) = delete;
+        ContextBinding& operator=(const ContextBinding&) = delete;
+
+    private:
+        S3L_Context* _previous;
+    };
+
+    /**
+     * Everything needed to render one view: the rasterizer state (resolution, z-buffer),
+     * the target it draws into and the models queued for the frame.
+     * Separate views can be rendered on separate threads at the same time. The only state
+     * contexts can share is the vertex cache of a static model, which is only used by the
+     * first context that draws the model. A context itself must only be used by one thread at a time.
+     */
+    struct RenderContext {
+        RenderContext() NOEXCEPT {
+            S3L_contextInit(S3L_defaultContext.resolutionX, S3L_defaultContext.resolutionY, &_s3l);
+            _s3l.userData = this;
+        }
+
+        ~RenderContext() { S3L_contextFree(&_s3l); }
+
+        RenderContext(const RenderContext&) = delete;
+        RenderContext& operator=(const RenderContext&) = delete;
+
+        /// The context whose scene is being rasterized on this thread, used by the span function.
+        NODISCARD static RenderContext* current() NOEXCEPT {
+            return static_cast<RenderContext*>(S3L_context->userData);
+        }
+
+        /**
+         * Sets where spans are drawn to. `resolution` is in rasterizer pixels (two rows per cell),
+         * like in initialize_screen(), unless drawing to subcells.
+         */
+        void set_target(char* data, int stride, api::Coords resolution) NOEXCEPT {
+            debug_assert(data and stride > 0, "Invalid render target.");
+            _target = data;
+            _stride = stride;
+            _s3l.resolutionX = static_cast<uint16_t>(resolution.x);
+            _s3l.resolutionY = static_cast<uint16_t>(resolution.y);
+        }
+
+        /**
+         * Sends spans to `subcells` instead of the target, which it should later be resolved into.
+         * The resolution set with set_target must then be SubcellBuffer::get_resolution of the cells.
+         */
+        void set_subcells(SubcellBuffer* subcells) NOEXCEPT { _subcells = subcells; }
+
+        /// Rasterizes on the pool instead of the calling thread. Pools must not be shared by contexts in use at once.
+        void set_rasterizer(TileRasterizer* rasterizer) NOEXCEPT { _rasterizer = rasterizer; }
+
+        /// Clears the depth and the occluders, and resets the counters.
+        void begin_frame() NOEXCEPT {
+            ContextBinding bind(&_s3l);
+            S3L_newFrame();
+            _drawn = _culled = _occluded = 0;
+            _occluders.clear();
+            _queue.set_occluders(nullptr);
+            _queue.begin_frame();
+        }
+
+        /// See RenderQueue::push.
+        std::uint8_t* push(const S3L_Model3D& model, const S3L_Camera& camera,
+                           std::uint8_t palette, bool cull = true) NOEXCEPT {
+            ContextBinding bind(&_s3l);
+            return _queue.push(model, camera, palette, cull);
+        }
+
+        /// See RenderQueue::push_instances.
+        template <typename F>
+        std::size_t push_instances(const S3L_Model3D& model, std::span<const S3L_Transform3D> transforms,
+                                   const S3L_Camera& camera, std::uint8_t palette, F&& light) NOEXCEPT {
+            ContextBinding bind(&_s3l);
+            return _queue.push_instances(model, transforms, camera, palette, std::forward<F>(light));
+        }
+
+        /// Culls and rasterizes everything queued since the last call, in one scene.
+        void draw_scene(const S3L_Camera& camera) NOEXCEPT {
+            _drawn += _queue.size();
+            _culled += _queue.culled_count();
+            _occluded += _queue.occluded_count();
+
+            if(_queue.empty()) {
+                _queue.clear();
+                return;
+            }
+
+            ContextBinding bind(&_s3l);
+            S3L_Scene scene = _queue.get_scene(camera);
+
+            if(_rasterizer) _rasterizer->draw_scene(scene);
+            else S3L_drawScene(scene);
+
+            _queue.clear();
+        }
+
+        /**
+         * Draws everything queued so far (meant for large occluders) and builds a depth pyramid
+         * from it. Models pushed after this in the same frame are skipped if they're hidden.
+         */
+        void draw_occluders(const S3L_Camera& camera) NOEXCEPT {
+            draw_scene(camera);
+            ContextBinding bind(&_s3l);
+            _occluders.build();
+            _queue.set_occluders(&_occluders);
+        }
+
+        void shade_span(const S3L_SpanInfo& span) NOEXCEPT {
+            if(_subcells) {
+                const uint8_t luminance = _queue.get_luminance(span.modelIndex)[span.triangleIndex];
+                _subcells->write_span(span.x, span.y, span.length, _queue.get_info(span.modelIndex).palette, luminance);
+                return;
+            }
+            _shade(span.x, span.y / 2, span.length, span.modelIndex, span.triangleIndex);
+        }
+
+        NODISCARD S3L_Context* get_s3l_context() NOEXCEPT { return &_s3l; }
+        NODISCARD RenderQueue& get_queue() NOEXCEPT { return _queue; }
+
+        /// Models drawn, culled and occluded since begin_frame().
+        NODISCARD std::size_t drawn_count() CNOEXCEPT { return _drawn; }
+        NODISCARD std::size_t culled_count() CNOEXCEPT { return _culled; }
+        NODISCARD std::size_t occluded_count() CNOEXCEPT { return _occluded; }
+
+    private:
+        void _shade(int x, int y, int length, S3L_Index model_index, S3L_Index triangle_index) NOEXCEPT {
+            const uint8_t palette = _queue.get_info(model_index).palette;
+            const uint8_t luminance = _queue.get_luminance(model_index)[triangle_index];
+            debug_assert(palette < palette_count, "Invalid palette.");
+            std::memset(_target + x + (y * _stride), glyph_table[palette][luminance], length);
+        }
+
+    private:
+        S3L_Context _s3l;
+        char* _target = nullptr;
+        int _stride = 0;
+        TileRasterizer* _rasterizer = nullptr;
+        SubcellBuffer* _subcells = nullptr;
+
+        RenderQueue _queue;
+        DepthPyramid _occluders;
+        std::size_t _drawn = 0, _culled = 0, _occluded = 0;
+    };
+}
+
+/// Spans go to whichever context is rasterizing on the calling thread.
+inline void S3L_SPAN_FUNCTION(S3L_SpanInfo *s) {
+    render::RenderContext::current()->shade_span(*s);
+}
+
+#endif //PROJECT3_TEST_RENDER_CONTEXT_HPP
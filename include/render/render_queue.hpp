@@ -0,0 +1,297 @@
+#ifndef PROJECT3_TEST_RENDER_QUEUE_HPP
+#define PROJECT3_TEST_RENDER_QUEUE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <render/depth_pyramid.hpp>
+#include <render/small3dlib.hpp>
+#include <config.hpp>
+
+namespace render {
+    /**
+     * Model space bounds of a model's vertices.
+     */
+    struct BoundingSphere {
+        S3L_Vec4 center;
+        S3L_Unit radius;
+    };
+
+    inline BoundingSphere compute_bounding_sphere(const S3L_Model3D& model) NOEXCEPT {
+        BoundingSphere sphere {};
+        S3L_vec4Init(&sphere.center);
+        if(not model.vertexCount) return sphere;
+
+        S3L_Unit min[3], max[3];
+        std::copy(model.vertices, model.vertices + 3, min);
+        std::copy(model.vertices, model.vertices + 3, max);
+        for(S3L_Index i = 1; i < model.vertexCount; ++i) {
+            for(int axis = 0; axis < 3; ++axis) {
+                min[axis] = std::min(min[axis], model.vertices[i * 3 + axis]);
+                max[axis] = std::max(max[axis], model.vertices[i * 3 + axis]);
+            }
+        }
+
+        sphere.center.x = (min[0] + max[0]) / 2;
+        sphere.center.y = (min[1] + max[1]) / 2;
+        sphere.center.z = (min[2] + max[2]) / 2;
+
+        double radius_sq = 0.0;
+        for(S3L_Index i = 0; i < model.vertexCount; ++i) {
+            const double dx = model.vertices[i * 3 + 0] - sphere.center.x;
+            const double dy = model.vertices[i * 3 + 1] - sphere.center.y;
+            const double dz = model.vertices[i * 3 + 2] - sphere.center.z;
+            radius_sq = std::max(radius_sq, dx * dx + dy * dy + dz * dz);
+        }
+
+        sphere.radius = static_cast<S3L_Unit>(std::ceil(std::sqrt(radius_sq)));
+        return sphere;
+    }
+
+    /**
+     * Collects the models drawn during a frame, culls them against the view frustum
+     * (and the occluders, once set) and hands the survivors to the rasterizer as a single scene.
+     * Models are copied when pushed, so the same S3L_Model3D can be queued many times.
+     * Bounds used for culling are cached per vertex buffer: a buffer whose vertices are
+     * changed or that is freed must be passed to invalidate_bounds() first.
+     */
+    struct RenderQueue {
+        /// What the fragment functions need to know about a queued model.
+        struct DrawInfo {
+            std::uint32_t luminance_offset;
+            std::uint8_t palette;
+        };
+
+        /**
+         * Queues a model with its current transform and config.
+         * @return Storage for one luminance value per triangle, or nullptr if the model was culled.
+         * The pointer is only valid until the next push.
+         */
+        std::uint8_t* push(const S3L_Model3D& model, const S3L_Camera& camera,
+                           std::uint8_t palette, bool cull = true) NOEXCEPT {
+            if(cull and _is_culled(model, camera)) {
+                ++_culled;
+                return nullptr;
+            }
+
+            const auto offset = static_cast<std::uint32_t>(_luminance.size());
+            _models.push_back(model);
+            _info.push_back({ offset, palette });
+            _luminance.resize(offset + model.triangleCount);
+            return _luminance.data() + offset;
+        }
+
+        /**
+         * Queues a copy of the model for every transform, sharing the camera setup and
+         * bounds lookup across the batch. Instances with the same rotation as the previous
+         * visible one share its lighting, so `light(transform, luminance)` only runs when it changes.
+         * @return The number of instances that weren't culled.
+         */
+        template <typename F>
+        std::size_t push_instances(const S3L_Model3D& model, std::span<const S3L_Transform3D> transforms,
+                                   const S3L_Camera& camera, std::uint8_t palette, F&& light) NOEXCEPT {
+            const BoundingSphere* bounds = nullptr;
+            if(not model.customTransformMatrix) {
+                _update_camera(camera);
+                bounds = &_get_bounds(model);
+            }
+
+            _models.reserve(_models.size() + transforms.size());
+            _info.reserve(_info.size() + transforms.size());
+
+            const S3L_Vec4* lit_rotation = nullptr;
+            std::uint32_t lit_offset = 0;
+            std::size_t pushed = 0;
+            for(const S3L_Transform3D& transform : transforms) {
+                if(bounds and _is_culled(*bounds, transform)) {
+                    ++_culled;
+                    continue;
+                }
+
+                S3L_Model3D& instance = _models.emplace_back(model);
+                instance.transform = transform;
+
+                const S3L_Vec4& rotation = transform.rotation;
+                if(not lit_rotation or std::memcmp(lit_rotation, &rotation, sizeof(S3L_Vec4)) != 0) {
+                    lit_offset = static_cast<std::uint32_t>(_luminance.size());
+                    _luminance.resize(lit_offset + model.triangleCount);
+                    light(transform, _luminance.data() + lit_offset);
+                    lit_rotation = &rotation;
+                }
+
+                _info.push_back({ lit_offset, palette });
+                ++pushed;
+            }
+            return pushed;
+        }
+
+        /// The queued models as a scene. Only valid until the queue is modified.
+        NODISCARD S3L_Scene get_scene(const S3L_Camera& camera) NOEXCEPT {
+            S3L_Scene scene;
+            S3L_sceneInit(_models.data(), static_cast<S3L_Index>(_models.size()), &scene);
+            scene.camera = camera;
+            return scene;
+        }
+
+        void clear() NOEXCEPT {
+            _models.clear();
+            _info.clear();
+            _luminance.clear();
+            _culled = 0;
+            _occluded = 0;
+        }
+
+        /// Models pushed from now on are also tested against this depth pyramid, nullptr turns it off.
+        void set_occluders(const DepthPyramid* occluders) NOEXCEPT {
+            _occluders = occluders;
+        }
+
+        /// Drops the cached bounds of a vertex buffer, call before changing its vertices or freeing it.
+        void invalidate_bounds(const S3L_Unit* vertices) NOEXCEPT {
+            _bounds.erase(vertices);
+        }
+
+        /// Forgets the bounds of vertex buffers that haven't been drawn for a while, call once per frame.
+        void begin_frame() NOEXCEPT {
+            if(++_frame % bounds_lifetime) return;
+            std::erase_if(_bounds, [this](const auto& entry) {
+                return _frame - entry.second.last_used > bounds_lifetime;
+            });
+        }
+
+        NODISCARD const DrawInfo& get_info(S3L_Index model_index) CNOEXCEPT {
+            return _info[model_index];
+        }
+
+        NODISCARD const std::uint8_t* get_luminance(S3L_Index model_index) CNOEXCEPT {
+            return _luminance.data() + _info[model_index].luminance_offset;
+        }
+
+        NODISCARD std::size_t size() CNOEXCEPT { return _models.size(); }
+        NODISCARD bool empty() CNOEXCEPT { return _models.empty(); }
+        NODISCARD std::size_t culled_count() CNOEXCEPT { return _culled; }
+        NODISCARD std::size_t occluded_count() CNOEXCEPT { return _occluded; }
+
+    private:
+        static constexpr std::uint32_t bounds_lifetime = 64;    // In frames
+
+        /**
+         * Bounds cached per vertex buffer. Only the vertex count is checked on lookup, so a model
+         * drawing fewer or more vertices of the buffer is measured again. Changed vertices aren't
+         * noticed, see invalidate_bounds().
+         */
+        struct CachedBounds {
+            BoundingSphere sphere;
+            S3L_Index vertex_count;
+            std::uint32_t last_used;
+
+            NODISCARD static CachedBounds make(const S3L_Model3D& model) NOEXCEPT {
+                return { compute_bounding_sphere(model), model.vertexCount, 0 };
+            }
+
+            NODISCARD bool matches(const S3L_Model3D& model) CNOEXCEPT {
+                return vertex_count == model.vertexCount;
+            }
+        };
+
+        /// Rebuilds the camera matrix only when the camera or the resolution has actually changed.
+        void _update_camera(const S3L_Camera& camera) NOEXCEPT {
+            const bool same_resolution = (_resolution_x == S3L_RESOLUTION_X and _resolution_y == S3L_RESOLUTION_Y);
+            if(_has_camera and same_resolution and std::memcmp(&camera, &_camera, sizeof(S3L_Camera)) == 0) return;
+
+            _camera = camera;
+            _has_camera = true;
+            _resolution_x = S3L_RESOLUTION_X;
+            _resolution_y = S3L_RESOLUTION_Y;
+            S3L_makeCameraMatrix(camera.transform, _camera_matrix);
+
+            /// A point is on screen when |x| <= z * _slope_x and |y| <= z * _slope_y
+            const double focal = std::max<S3L_Unit>(1, camera.focalLength);
+            _slope_x = double(S3L_FRACTIONS_PER_UNIT) / focal;
+            _slope_y = _slope_x * double(S3L_RESOLUTION_Y) / std::max(1.0, double(S3L_RESOLUTION_X));
+            _norm_x = std::sqrt(1.0 + _slope_x * _slope_x);
+            _norm_y = std::sqrt(1.0 + _slope_y * _slope_y);
+        }
+
+        const BoundingSphere& _get_bounds(const S3L_Model3D& model) NOEXCEPT {
+            auto [it, inserted] = _bounds.try_emplace(model.vertices);
+            if(inserted or not it->second.matches(model)) it->second = CachedBounds::make(model);
+            it->second.last_used = _frame;
+            return it->second.sphere;
+        }
+
+        NODISCARD bool _is_culled(const S3L_Model3D& model, const S3L_Camera& camera) NOEXCEPT {
+            if(model.customTransformMatrix) return false;
+            _update_camera(camera);
+            return _is_culled(_get_bounds(model), model.transform);
+        }
+
+        NODISCARD bool _is_culled(const BoundingSphere& bounds, const S3L_Transform3D& transform) NOEXCEPT {
+            S3L_Mat4 m;
+            S3L_makeWorldMatrix(transform, m);
+            S3L_mat4Xmat4(m, _camera_matrix);
+
+            S3L_Vec4 center = bounds.center;
+            center.w = S3L_FRACTIONS_PER_UNIT;
+            S3L_vec3Xmat4(&center, m);
+
+            const S3L_Vec4& scale = transform.scale;
+            const S3L_Unit max_scale = std::max({ S3L_abs(scale.x), S3L_abs(scale.y), S3L_abs(scale.z) });
+            const double radius = double(bounds.radius) * max_scale / S3L_FRACTIONS_PER_UNIT;
+
+            const double x = center.x, y = center.y, z = center.z;
+            if(z + radius < S3L_NEAR) return true;
+            if(std::abs(x) - z * _slope_x > radius * _norm_x) return true;
+            if(std::abs(y) - z * _slope_y > radius * _norm_y) return true;
+
+            if(_occluders and _is_occluded(x, y, z, radius)) {
+                ++_occluded;
+                return true;
+            }
+            return false;
+        }
+
+        /**
+         * Projects the view space sphere to a screen rectangle that's guaranteed to contain it,
+         * see S3L_perspectiveDivide and S3L_mapProjectionPlaneToScreen.
+         */
+        NODISCARD bool _is_occluded(double x, double y, double z, double radius) CNOEXCEPT {
+            const double near = z - radius;
+            if(near <= S3L_NEAR) return false;
+
+            const double far = z + radius;
+            const double scale = double(_camera.focalLength) * S3L_HALF_RESOLUTION_X / S3L_FRACTIONS_PER_UNIT;
+            auto project_min = [&](double v) { return (v - radius) * scale / ((v - radius < 0) ? near : far); };
+            auto project_max = [&](double v) { return (v + radius) * scale / ((v + radius > 0) ? near : far); };
+
+            const int x0 = static_cast<int>(std::floor(S3L_HALF_RESOLUTION_X + project_min(x)));
+            const int x1 = static_cast<int>(std::ceil(S3L_HALF_RESOLUTION_X + project_max(x)));
+            const int y0 = static_cast<int>(std::floor(S3L_HALF_RESOLUTION_Y - project_max(y)));
+            const int y1 = static_cast<int>(std::ceil(S3L_HALF_RESOLUTION_Y - project_min(y)));
+            return _occluders->is_occluded(x0, y0, x1, y1, static_cast<S3L_Unit>(near));
+        }
+
+    private:
+        std::vector<S3L_Model3D> _models;
+        std::vector<DrawInfo> _info;
+        std::vector<std::uint8_t> _luminance;
+        std::unordered_map<const S3L_Unit*, CachedBounds> _bounds;
+        std::uint32_t _frame = 0;
+        std::size_t _culled = 0;                    // Includes the occluded models
+        std::size_t _occluded = 0;
+        const DepthPyramid* _occluders = nullptr;
+
+        S3L_Camera _camera {};
+        S3L_Mat4 _camera_matrix {};
+        double _slope_x = 1.0, _slope_y = 1.0;
+        double _norm_x = 1.0, _norm_y = 1.0;
+        int _resolution_x = 0, _resolution_y = 0;
+        bool _has_camera = false;
+    };
+}
+
+#endif //PROJECT3_TEST_RENDER_QUEUE_HPP
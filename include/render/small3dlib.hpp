@@ -16,6 +16,11 @@
   function you'll be using to draw single pixels (this function will be called
   by the library to render the frames). Also either init S3L_resolutionX and
   S3L_resolutionY or define S3L_RESOLUTION_X and S3L_RESOLUTION_Y.
+  The resolution, z-buffer and scratch memory live in an S3L_Context; every
+  thread draws with the one S3L_context points to (S3L_defaultContext unless
+  changed), so several views can be rendered at once from different threads.
+  Alternatively define S3L_SPAN_FUNCTION, which gets whole horizontal runs of
+  pixels that passed the z-test instead (no barycentrics are computed then).
 
   You'll also need to decide what rendering strategy and other settings you
   want to use, depending on your specific usecase. You may want to use a
@@ -131,12 +136,16 @@
 #define S3L_USE_WIDER_TYPES 1
 #define S3L_MAX_PIXELS 3686400
 #define S3L_PIXEL_FUNCTION S3L_draw_pixel
+#define S3L_SPAN_FUNCTION S3L_draw_span
 #define S3L_PERSPECTIVE_CORRECTION 2
 #define SCALE_3D_RENDERING 1
 #define S3L_NEAR (S3L_FRACTIONS_PER_UNIT / (4 * SCALE_3D_RENDERING))
-#define S3L_Z_BUFFER 1
+#define S3L_Z_BUFFER 3
 #define S3L_NEAR_CROSS_STRATEGY 3
+#include <atomic>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 #ifdef S3L_RESOLUTION_X
   #ifdef S3L_RESOLUTION_Y
@@ -150,11 +159,10 @@
            S3L_MAX_PIXELS not defined!
   #endif
 
-inline uint16_t S3L_resolutionX = 512; /**< If a static resolution is not set with
-                                       S3L_RESOLUTION_X, this variable can be
-                                       used to change X resolution at runtime,
-                                       in which case S3L_MAX_PIXELS has to be
-                                       defined (to allocate zBuffer etc.)! */
+  /** If a static resolution is not set with S3L_RESOLUTION_X, this can be
+  used to change X resolution of the current context at runtime, in which case
+  S3L_MAX_PIXELS has to be defined (to allocate zBuffer etc.)! */
+  #define S3L_resolutionX (S3L_context->resolutionX)
   #define S3L_RESOLUTION_X S3L_resolutionX
 #endif
 
@@ -164,8 +172,8 @@ inline uint16_t S3L_resolutionX = 512; /**< If a static resolution is not set wi
            S3L_MAX_PIXELS not defined!
   #endif
 
-inline uint16_t S3L_resolutionY = 512; /**< Same as S3L_resolutionX, but for Y
-                                       resolution. */
+  /** Same as S3L_resolutionX, but for Y resolution. */
+  #define S3L_resolutionY (S3L_context->resolutionY)
   #define S3L_RESOLUTION_Y S3L_resolutionY
 #endif
 
@@ -306,11 +314,35 @@ typedef
      memory.
   2: Use reduced-size z-buffer (of bytes). This is fast and somewhat accurate,
      but inaccuracies can occur and a considerable amount of memory is
-     needed. */
+     needed.
+  3: Use full z-buffer where every entry is tagged with the frame generation
+     it was written in. Clearing is then just a generation bump, and the buffer
+     is allocated to the current resolution instead of S3L_MAX_PIXELS. */
 
   #define S3L_Z_BUFFER 0 
 #endif
 
+#ifndef S3L_SIMD
+  /** Whether to use SIMD kernels (where the CPU supports them at runtime) for
+  transforming vertices. The results are the same as without them. */
+
+  #define S3L_SIMD 1
+#endif
+
+#if S3L_SIMD && S3L_USE_WIDER_TYPES && (defined(__x86_64__) || defined(_M_X64))
+  #if defined(__GNUC__) || defined(__clang__)
+    #define S3L_AVX2_TARGET __attribute__((target("avx2")))
+    #define S3L_AVX2_SUPPORTED() __builtin_cpu_supports("avx2")
+  #elif defined(__AVX2__)
+    #define S3L_AVX2_TARGET
+    #define S3L_AVX2_SUPPORTED() 1
+  #endif
+#endif
+
+#ifdef S3L_AVX2_TARGET
+  #include <immintrin.h>
+#endif
+
 #ifndef S3L_REDUCED_Z_BUFFER_GRANULARITY
   /** For S3L_Z_BUFFER == 2 this sets the reduced z-buffer granularity. */
 
@@ -549,6 +581,24 @@ typedef struct
 
 void S3L_drawConfigInit(S3L_DrawConfig *config);
 
+typedef struct
+{
+  S3L_Unit *vertices;  /**< Camera space vertices, 3 values per vertex of the
+                            model the cache belongs to. */
+  S3L_Mat4 matrix;     ///< Matrix the vertices were last transformed with.
+  uint8_t valid;       ///< 0 if the vertices have to be transformed again.
+  const void *owner;   /**< Context that first drew with the cache, others
+                            transform the model as if it had none. */
+} S3L_VertexCache;     /**< Keeps the transformed vertices of a static model
+                            between frames, so they only have to be computed
+                            again when the model or the camera moves. */
+
+void S3L_vertexCacheInit(S3L_Unit *vertices, S3L_VertexCache *cache);
+
+/** Marks the cache dirty, call this if the model's vertices are changed (moving
+  the model or the camera is detected automatically). */
+static inline void S3L_vertexCacheInvalidate(S3L_VertexCache *cache);
+
 typedef struct S3L_Model3D
 {
   const S3L_Unit *vertices;
@@ -560,6 +610,11 @@ typedef struct S3L_Model3D
                                      transform (if != 0) with a custom
                                      transform matrix, which is more
                                      general. */
+  const S3L_Unit *triangleNormals; /**< Optional precomputed model space
+                                     normal of each triangle (3 values per
+                                     triangle), 0 if not available. */
+  S3L_VertexCache *vertexCache; /**< Set for static models to reuse the
+                                     transformed vertices, 0 by default. */
   S3L_DrawConfig config;
 } S3L_Model3D;                ///< Represents a 3D model.
 
@@ -613,7 +668,24 @@ typedef struct S3L_PixelInfo
 } S3L_PixelInfo;         /**< Used to pass the info about a rasterized pixel
                               (fragment) to the user-defined drawing func. */
 
+typedef struct
+{
+  S3L_ScreenCoord x;       ///< Screen X coordinate of the first pixel.
+  S3L_ScreenCoord y;       ///< Screen Y coordinate.
+  S3L_ScreenCoord length;  ///< Number of pixels, always at least 1.
+  S3L_Unit depth[2];       ///< Depth of the first and the last pixel.
+  S3L_Index modelIndex;    ///< Model index within the scene.
+  S3L_Index triangleIndex; ///< Triangle index within the model.
+  uint32_t triangleID;     ///< Same as in S3L_PixelInfo.
+} S3L_SpanInfo;            /**< A horizontal run of pixels of one triangle that
+                                all passed the z-test, passed to
+                                S3L_SPAN_FUNCTION if it is defined. */
+
+#ifdef S3L_SPAN_FUNCTION
+void S3L_SPAN_FUNCTION(S3L_SpanInfo *span); // forward decl
+#else
 void S3L_PIXEL_FUNCTION(S3L_PixelInfo *pixel); // forward decl
+#endif
 
 static inline void S3L_pixelInfoInit(S3L_PixelInfo *p);
 
@@ -814,6 +886,41 @@ static inline void S3L_rotate2DPoint(S3L_Unit *x, S3L_Unit *y, S3L_Unit angle);
 
 #define S3L_UNUSED(what) (void)(what) ///< helper macro for unused vars
 
+/** State the rasterizer keeps between calls. Threads that help drawing the
+  same scene (e.g. by splitting it into bands) have to point S3L_context at the
+  same context, threads drawing different views need their own. */
+typedef struct
+{
+  uint16_t resolutionX;
+  uint16_t resolutionY;
+#if S3L_Z_BUFFER == 3
+  uint64_t *zBuffer;
+  uint32_t zBufferCapacity;
+  uint32_t zBufferGeneration;
+#endif
+  S3L_Unit *vertexScratch;
+  uint32_t vertexScratchCapacity;
+  void *userData;          /**< Not used by the library, lets the pixel/span
+                                function find out what it's drawing to. */
+} S3L_Context;
+
+/** Sets up an empty context, memory is allocated by the first S3L_newFrame. */
+void S3L_contextInit(uint16_t resolutionX, uint16_t resolutionY,
+  S3L_Context *context);
+
+/** Frees the memory of a context, which can then be initialized again. */
+void S3L_contextFree(S3L_Context *context);
+
+inline S3L_Context S3L_defaultContext =
+{
+  512, 512,
+#if S3L_Z_BUFFER == 3
+  0, 0, 0,
+#endif
+  0, 0, 0
+};
+inline thread_local S3L_Context *S3L_context = &S3L_defaultContext;
+
 #define S3L_HALF_RESOLUTION_X (S3L_RESOLUTION_X >> 1)
 #define S3L_HALF_RESOLUTION_Y (S3L_RESOLUTION_Y >> 1)
 
@@ -824,12 +931,42 @@ static inline void S3L_rotate2DPoint(S3L_Unit *x, S3L_Unit *y, S3L_Unit angle);
 #define S3L_MAX_DEPTH 2147483647
 inline S3L_Unit S3L_zBuffer[S3L_MAX_PIXELS];
 #define S3L_zBufferFormat(depth) (depth)
+#define S3L_zBufferDecode(value) (value)
 #elif S3L_Z_BUFFER == 2
 #define S3L_MAX_DEPTH 255
   uint8_t S3L_zBuffer[S3L_MAX_PIXELS];
   #define S3L_zBufferFormat(depth)\
     S3L_min(255,(depth) >> S3L_REDUCED_Z_BUFFER_GRANULARITY)
+#define S3L_zBufferDecode(value) (value)
+#elif S3L_Z_BUFFER == 3
+#define S3L_MAX_DEPTH 2147483647
+/* Each entry holds (generation << 32) | (S3L_MAX_DEPTH - depth), so a closer
+  pixel from the current frame always compares greater than anything left over
+  from a previous frame, and a zeroed entry reads as S3L_MAX_DEPTH. Depths are
+  clamped to [0, S3L_MAX_DEPTH] first, anything outside would wrap around. */
+#define S3L_zBuffer (S3L_context->zBuffer)
+#define S3L_zBufferCapacity (S3L_context->zBufferCapacity)
+#define S3L_zBufferGeneration (S3L_context->zBufferGeneration)
+#define S3L_zBufferFormat(depth)\
+  ((((uint64_t) S3L_zBufferGeneration) << 32) |\
+   ((uint32_t) S3L_MAX_DEPTH - (uint32_t) S3L_clamp((depth),0,S3L_MAX_DEPTH)))
+#define S3L_zBufferDecode(value)\
+  ((uint32_t) ((value) >> 32) == S3L_zBufferGeneration ?\
+   (S3L_Unit) ((uint32_t) S3L_MAX_DEPTH - (uint32_t) (value)) : S3L_MAX_DEPTH)
+#endif
+
+/** 0 if the z-buffer of the current context couldn't be allocated (or is too
+  small for the resolution because S3L_newFrame wasn't called since it grew),
+  in which case nothing can be drawn. */
+static inline int8_t S3L_zBufferReady()
+{
+#if S3L_Z_BUFFER == 3
+    return S3L_zBuffer != 0 &&
+        S3L_zBufferCapacity >= (uint32_t) S3L_RESOLUTION_X * S3L_RESOLUTION_Y;
+#else
+    return 1;
 #endif
+}
 
 #if S3L_Z_BUFFER
 static inline int8_t S3L_zTest(
@@ -839,6 +976,17 @@ static inline int8_t S3L_zTest(
 {
     uint32_t index = y * S3L_RESOLUTION_X + x;
 
+#if S3L_Z_BUFFER == 3
+    uint64_t value = S3L_zBufferFormat(depth);
+
+    if (value > S3L_zBuffer[index])
+    {
+        S3L_zBuffer[index] = value;
+        return 1;
+    }
+
+    return 0;
+#else
     depth = S3L_zBufferFormat(depth);
 
 #if S3L_Z_BUFFER == 2
@@ -860,13 +1008,18 @@ static inline int8_t S3L_zTest(
 #undef cmp
 
     return 0;
+#endif
 }
 #endif
 
 inline S3L_Unit S3L_zBufferRead(S3L_ScreenCoord x, S3L_ScreenCoord y)
 {
+#if S3L_Z_BUFFER == 3
+    if (S3L_zBuffer == 0)
+      return S3L_MAX_DEPTH;
+#endif
 #if S3L_Z_BUFFER
-    return S3L_zBuffer[y * S3L_RESOLUTION_X + x];
+    return S3L_zBufferDecode(S3L_zBuffer[y * S3L_RESOLUTION_X + x]);
 #else
     S3L_UNUSED(x);
     S3L_UNUSED(y);
@@ -877,7 +1030,10 @@ inline S3L_Unit S3L_zBufferRead(S3L_ScreenCoord x, S3L_ScreenCoord y)
 
 inline void S3L_zBufferWrite(S3L_ScreenCoord x, S3L_ScreenCoord y, S3L_Unit value)
 {
-#if S3L_Z_BUFFER
+#if S3L_Z_BUFFER == 3
+    if (S3L_zBuffer != 0)
+      S3L_zBuffer[y * S3L_RESOLUTION_X + x] = S3L_zBufferFormat(value);
+#elif S3L_Z_BUFFER
     S3L_zBuffer[y * S3L_RESOLUTION_X + x] = value;
 #else
     S3L_UNUSED(x);
@@ -1855,6 +2011,8 @@ inline void S3L_model3DInit(
     model->triangles = triangles;
     model->triangleCount = triangleCount;
     model->customTransformMatrix = nullptr;
+    model->triangleNormals = nullptr;
+    model->vertexCache = nullptr;
 
     S3L_transform3DInit(&(model->transform));
     S3L_drawConfigInit(&(model->config));
@@ -1876,7 +2034,7 @@ inline void S3L_drawConfigInit(S3L_DrawConfig *config)
     config->visible = 1;
 }
 
-#ifndef S3L_PIXEL_FUNCTION
+#if !defined(S3L_PIXEL_FUNCTION) && !defined(S3L_SPAN_FUNCTION)
 #error Pixel rendering function (S3L_PIXEL_FUNCTION) not specified!
 #endif
 
@@ -1934,7 +2092,28 @@ inline void S3L_mapProjectionPlaneToScreen(
 
 inline void S3L_zBufferClear()
 {
-#if S3L_Z_BUFFER
+#if S3L_Z_BUFFER == 3
+    uint32_t size = S3L_RESOLUTION_X * S3L_RESOLUTION_Y;
+
+    if (size > S3L_zBufferCapacity)
+    {
+        // entries only need to be zeroed on allocation, after that they go
+        // stale by themselves when the generation changes
+        std::free(S3L_zBuffer);
+        S3L_zBuffer = (uint64_t *) std::calloc(size,sizeof(uint64_t));
+        S3L_zBufferGeneration = 1;
+
+        // without memory the context stays empty, see S3L_zBufferReady
+        S3L_zBufferCapacity = S3L_zBuffer != nullptr ? size : 0;
+        return;
+    }
+
+    if (++S3L_zBufferGeneration == 0)
+    {
+        std::memset(S3L_zBuffer,0,S3L_zBufferCapacity * sizeof(uint64_t));
+        S3L_zBufferGeneration = 1;
+    }
+#elif S3L_Z_BUFFER
     for (uint32_t i = 0; i < S3L_RESOLUTION_X * S3L_RESOLUTION_Y; ++i)
         S3L_zBuffer[i] = S3L_MAX_DEPTH;
 #endif
@@ -1954,23 +2133,64 @@ inline void S3L_newFrame()
     S3L_stencilBufferClear();
 }
 
+inline void S3L_contextInit(uint16_t resolutionX, uint16_t resolutionY,
+  S3L_Context *context)
+{
+    std::memset(context,0,sizeof(S3L_Context));
+    context->resolutionX = resolutionX;
+    context->resolutionY = resolutionY;
+}
+
+inline void S3L_contextFree(S3L_Context *context)
+{
+#if S3L_Z_BUFFER == 3
+    std::free(context->zBuffer);
+#endif
+    std::free(context->vertexScratch);
+    S3L_contextInit(context->resolutionX,context->resolutionY,context);
+}
+
 /*
   the following serves to communicate info about if the triangle has been split
   and how the barycentrics should be remapped.
 */
-inline uint8_t _S3L_projectedTriangleState = 0; // 0 = normal, 1 = cut, 2 = split
+inline thread_local uint8_t _S3L_projectedTriangleState = 0; // 0 = normal, 1 = cut, 2 = split
 
 #if S3L_NEAR_CROSS_STRATEGY == 3
-inline S3L_Vec4 _S3L_triangleRemapBarycentrics[6];
+inline thread_local S3L_Vec4 _S3L_triangleRemapBarycentrics[6];
 #endif
 
-inline void S3L_drawTriangle(
+/* Span functions don't get barycentrics, so they're only interpolated for the
+  pixel function. */
+#if !S3L_FLAT && !defined(S3L_SPAN_FUNCTION)
+  #define _S3L_BARYCENTRICS 1
+#else
+  #define _S3L_BARYCENTRICS 0
+#endif
+
+/**
+  Same as S3L_drawTriangle, but only rasterizes rows in [clipTop, clipBottom),
+  and takes the near-plane split info explicitly instead of from the globals.
+  Rows above clipTop are still stepped through, so every drawn pixel is exactly
+  the same as when drawing the whole triangle -- this allows drawing horizontal
+  bands of the screen independently (and in parallel).
+*/
+inline void _S3L_drawTriangleRows(
         S3L_Vec4 point0,
         S3L_Vec4 point1,
         S3L_Vec4 point2,
         S3L_Index modelIndex,
-        S3L_Index triangleIndex)
+        S3L_Index triangleIndex,
+        S3L_ScreenCoord clipTop,
+        S3L_ScreenCoord clipBottom,
+        uint8_t projectedTriangleState,
+        const S3L_Vec4 *remapBarycentrics)
 {
+#if S3L_NEAR_CROSS_STRATEGY != 3 || defined(S3L_SPAN_FUNCTION)
+    S3L_UNUSED(projectedTriangleState);
+    S3L_UNUSED(remapBarycentrics);
+#endif
+
     S3L_PixelInfo p;
     S3L_pixelInfoInit(&p);
     p.modelIndex = modelIndex;
@@ -2181,10 +2401,11 @@ inline void S3L_drawTriangle(
 
     // clip to the screen in y dimension:
 
-    endY = S3L_min(endY,S3L_RESOLUTION_Y);
+    endY = S3L_min(endY,S3L_min(clipBottom,S3L_RESOLUTION_Y));
+    clipTop = S3L_max(clipTop,0);
 
-    /* Clipping above the screen (y < 0) can't be easily done here, will be
-       handled inside the loop. */
+    /* Clipping above the screen (y < clipTop) can't be easily done here, will
+       be handled inside the loop. */
 
     while (currentY < endY)   /* draw the triangle from top to bottom -- the
                                bottom-most row is left out because, following
@@ -2217,9 +2438,9 @@ inline void S3L_drawTriangle(
         stepSide(r)
         stepSide(l)
 
-        if (currentY >= 0) /* clipping of pixels whose y < 0 (can't be easily done
-                          outside the loop because of the Bresenham-like
-                          algorithm steps) */
+        if (currentY >= clipTop) /* clipping of pixels whose y < clipTop (can't be
+                          easily done outside the loop because of the
+                          Bresenham-like algorithm steps) */
         {
             p.y = currentY;
 
@@ -2229,18 +2450,24 @@ inline void S3L_drawTriangle(
             S3L_Unit rowLength = S3L_nonZero(rX - lX - 1); // prevent zero div
 
 #if S3L_PERSPECTIVE_CORRECTION
-            S3L_Unit lOverZ, lRecipZ, rOverZ, rRecipZ, lT, rT;
+            S3L_Unit lRecipZ, rRecipZ, lT, rT;
 
             lT = S3L_getFastLerpValue(lSideFLS);
             rT = S3L_getFastLerpValue(rSideFLS);
 
-            lOverZ  = S3L_interpolateByUnitFrom0(lRecip1,lT);
             lRecipZ = S3L_interpolateByUnit(lRecip0,lRecip1,lT);
+            rRecipZ = S3L_interpolateByUnit(rRecip0,rRecip1,rT);
+
+#if _S3L_BARYCENTRICS
+            S3L_Unit lOverZ, rOverZ;
 
+            lOverZ  = S3L_interpolateByUnitFrom0(lRecip1,lT);
             rOverZ  = S3L_interpolateByUnitFrom0(rRecip1,rT);
-            rRecipZ = S3L_interpolateByUnit(rRecip0,rRecip1,rT);
+#endif
 #else
+#if _S3L_BARYCENTRICS
             S3L_FastLerpState b0FLS, b1FLS;
+#endif
 
 #if S3L_COMPUTE_LERP_DEPTH
             S3L_FastLerpState  depthFLS;
@@ -2250,12 +2477,14 @@ inline void S3L_drawTriangle(
                     (rDepthFLS.valueScaled - lDepthFLS.valueScaled) / rowLength;
 #endif
 
+#if _S3L_BARYCENTRICS
             b0FLS.valueScaled = 0;
             b1FLS.valueScaled = lSideFLS.valueScaled;
 
             b0FLS.stepScaled = rSideFLS.valueScaled / rowLength;
             b1FLS.stepScaled = -1 * lSideFLS.valueScaled / rowLength;
 #endif
+#endif
 #endif
 
             // clip to the screen in x dimension:
@@ -2268,8 +2497,10 @@ inline void S3L_drawTriangle(
                 lXClipped = 0;
 
 #if !S3L_PERSPECTIVE_CORRECTION && !S3L_FLAT
+#if _S3L_BARYCENTRICS
                 b0FLS.valueScaled -= lX * b0FLS.stepScaled;
                 b1FLS.valueScaled -= lX * b1FLS.stepScaled;
+#endif
 
 #if S3L_COMPUTE_LERP_DEPTH
                 depthFLS.valueScaled -= lX * depthFLS.stepScaled;
@@ -2285,9 +2516,12 @@ inline void S3L_drawTriangle(
 
 #if S3L_PERSPECTIVE_CORRECTION == 2
             S3L_FastLerpState
-                    depthPC, // interpolates depth between row segments
-            b0PC,    // interpolates barycentric0 between row segments
+                    depthPC; // interpolates depth between row segments
+#if _S3L_BARYCENTRICS
+            S3L_FastLerpState
+                    b0PC,    // interpolates barycentric0 between row segments
             b1PC;    // interpolates barycentric1 between row segments
+#endif
 
             /* ^ These interpolate values between row segments (lines of pixels
                  of S3L_PC_APPROX_LENGTH length). After each row segment perspective
@@ -2298,6 +2532,7 @@ inline void S3L_drawTriangle(
                      S3L_nonZero(S3L_interpolate(lRecipZ,rRecipZ,i,rowLength)))
                             << S3L_FAST_LERP_QUALITY;
 
+#if _S3L_BARYCENTRICS
             b0PC.valueScaled =
                     (
                             S3L_interpolateFrom0(rOverZ,i,rowLength)
@@ -2309,6 +2544,7 @@ inline void S3L_drawTriangle(
                             (lOverZ - S3L_interpolateFrom0(lOverZ,i,rowLength))
                             * depthPC.valueScaled
                     ) / (Z_RECIP_NUMERATOR / S3L_FRACTIONS_PER_UNIT);
+#endif
 
             int8_t rowCount = S3L_PC_APPROX_LENGTH;
 #endif
@@ -2317,6 +2553,15 @@ inline void S3L_drawTriangle(
             uint32_t zBufferIndex = p.y * S3L_RESOLUTION_X + lXClipped;
 #endif
 
+#ifdef S3L_SPAN_FUNCTION
+            S3L_SpanInfo span;
+            span.y = p.y;
+            span.length = 0;
+            span.modelIndex = p.modelIndex;
+            span.triangleIndex = p.triangleIndex;
+            span.triangleID = p.triangleID;
+#endif
+
             // draw the row -- inner loop:
             for (S3L_ScreenCoord x = lXClipped; x < rXClipped; ++x)
             {
@@ -2352,6 +2597,7 @@ inline void S3L_drawTriangle(
                         depthPC.stepScaled =
                                 (nextDepthScaled - depthPC.valueScaled) / S3L_PC_APPROX_LENGTH;
 
+#if _S3L_BARYCENTRICS
                         S3L_Unit nextValue =
                                 (
                                         S3L_interpolateFrom0(rOverZ,nextI,rowLength)
@@ -2369,6 +2615,7 @@ inline void S3L_drawTriangle(
 
                         b1PC.stepScaled =
                                 (nextValue - b1PC.valueScaled) / S3L_PC_APPROX_LENGTH;
+#endif
                     }
                     else
                     {
@@ -2389,6 +2636,7 @@ inline void S3L_drawTriangle(
                         depthPC.stepScaled =
                                 (nextDepthScaled - depthPC.valueScaled) / maxI;
 
+#if _S3L_BARYCENTRICS
                         S3L_Unit nextValue =
                                 (
                                         rOverZ
@@ -2400,6 +2648,7 @@ inline void S3L_drawTriangle(
 
                         b1PC.stepScaled =
                                 -1 * b1PC.valueScaled / maxI;
+#endif
                     }
                 }
 
@@ -2413,7 +2662,7 @@ inline void S3L_drawTriangle(
 #endif
 
 #if S3L_Z_BUFFER
-                p.previousZ = S3L_zBuffer[zBufferIndex];
+                p.previousZ = S3L_zBufferDecode(S3L_zBuffer[zBufferIndex]);
 
                 zBufferIndex++;
 
@@ -2421,6 +2670,24 @@ inline void S3L_drawTriangle(
                     testsPassed = 0;
 #endif
 
+#ifdef S3L_SPAN_FUNCTION
+                if (testsPassed)
+                {
+                    if (span.length == 0)
+                    {
+                        span.x = x;
+                        span.depth[0] = p.depth;
+                    }
+
+                    span.depth[1] = p.depth;
+                    span.length++;
+                }
+                else if (span.length)
+                {
+                    S3L_SPAN_FUNCTION(&span);
+                    span.length = 0;
+                }
+#else
                 if (testsPassed)
                 {
 #if !S3L_FLAT
@@ -2449,26 +2716,26 @@ inline void S3L_drawTriangle(
 #endif
 
 #if S3L_NEAR_CROSS_STRATEGY == 3
-                    if (_S3L_projectedTriangleState != 0)
+                    if (projectedTriangleState != 0)
                     {
                         S3L_Unit newBarycentric[3];
 
                         newBarycentric[0] = S3L_interpolateBarycentric(
-                                _S3L_triangleRemapBarycentrics[0].x,
-                                _S3L_triangleRemapBarycentrics[1].x,
-                                _S3L_triangleRemapBarycentrics[2].x,
+                                remapBarycentrics[0].x,
+                                remapBarycentrics[1].x,
+                                remapBarycentrics[2].x,
                                 p.barycentric);
 
                         newBarycentric[1] = S3L_interpolateBarycentric(
-                                _S3L_triangleRemapBarycentrics[0].y,
-                                _S3L_triangleRemapBarycentrics[1].y,
-                                _S3L_triangleRemapBarycentrics[2].y,
+                                remapBarycentrics[0].y,
+                                remapBarycentrics[1].y,
+                                remapBarycentrics[2].y,
                                 p.barycentric);
 
                         newBarycentric[2] = S3L_interpolateBarycentric(
-                                _S3L_triangleRemapBarycentrics[0].z,
-                                _S3L_triangleRemapBarycentrics[1].z,
-                                _S3L_triangleRemapBarycentrics[2].z,
+                                remapBarycentrics[0].z,
+                                remapBarycentrics[1].z,
+                                remapBarycentrics[2].z,
                                 p.barycentric);
 
                         p.barycentric[0] = newBarycentric[0];
@@ -2478,6 +2745,7 @@ inline void S3L_drawTriangle(
 #endif
                     S3L_PIXEL_FUNCTION(&p);
                 } // tests passed
+#endif
 
 #if !S3L_FLAT
 #if S3L_PERSPECTIVE_CORRECTION
@@ -2486,15 +2754,22 @@ inline void S3L_drawTriangle(
                 rowCount++;
 
                 S3L_stepFastLerp(depthPC);
+#if _S3L_BARYCENTRICS
                 S3L_stepFastLerp(b0PC);
                 S3L_stepFastLerp(b1PC);
 #endif
-#else
+#endif
+#elif _S3L_BARYCENTRICS
                 S3L_stepFastLerp(b0FLS);
                 S3L_stepFastLerp(b1FLS);
 #endif
 #endif
             } // inner loop
+
+#ifdef S3L_SPAN_FUNCTION
+            if (span.length)
+                S3L_SPAN_FUNCTION(&span);
+#endif
         } // y clipping
 
 #if !S3L_FLAT
@@ -2517,6 +2792,23 @@ inline void S3L_drawTriangle(
 #undef Z_RECIP_NUMERATOR
 }
 
+inline void S3L_drawTriangle(
+        S3L_Vec4 point0,
+        S3L_Vec4 point1,
+        S3L_Vec4 point2,
+        S3L_Index modelIndex,
+        S3L_Index triangleIndex)
+{
+#if S3L_NEAR_CROSS_STRATEGY == 3
+    const S3L_Vec4 *remapBarycentrics = _S3L_triangleRemapBarycentrics;
+#else
+    const S3L_Vec4 *remapBarycentrics = 0;
+#endif
+
+    _S3L_drawTriangleRows(point0,point1,point2,modelIndex,triangleIndex,
+                          0,S3L_RESOLUTION_Y,_S3L_projectedTriangleState,remapBarycentrics);
+}
+
 inline void S3L_rotate2DPoint(S3L_Unit *x, S3L_Unit *y, S3L_Unit angle)
 {
     if (angle < S3L_SIN_TABLE_UNIT_STEP)
@@ -2667,15 +2959,244 @@ _S3L_TriangleToSort S3L_sortArray[S3L_MAX_TRIANGES_DRAWN];
 uint16_t S3L_sortArrayLength;
 #endif
 
+inline void S3L_vertexCacheInit(S3L_Unit *vertices, S3L_VertexCache *cache)
+{
+    cache->vertices = vertices;
+    cache->valid = 0;
+    cache->owner = 0;
+}
+
+/** Claims the cache for S3L_context if nobody has yet. Contexts can draw on
+  different threads, so only the owner may write to the cache, which also
+  keeps two cameras from evicting each other's vertices every draw. */
+inline int _S3L_vertexCacheClaim(S3L_VertexCache *cache)
+{
+    std::atomic_ref<const void *> owner(cache->owner);
+    const void *expected = 0;
+
+    return owner.compare_exchange_strong(expected,S3L_context) ||
+        expected == S3L_context;
+}
+
+static inline void S3L_vertexCacheInvalidate(S3L_VertexCache *cache)
+{
+    cache->valid = 0;
+}
+
+inline void _S3L_transformVerticesScalar(
+        const S3L_Unit *vertices,
+        uint32_t vertexCount,
+        S3L_Mat4 matrix,
+        S3L_Unit *result)
+{
+    for (uint32_t i = 0; i < vertexCount * 3; i += 3)
+    {
+        S3L_Vec4 v;
+
+        v.x = vertices[i];
+        v.y = vertices[i + 1];
+        v.z = vertices[i + 2];
+        v.w = S3L_FRACTIONS_PER_UNIT;
+
+        S3L_vec3Xmat4(&v,matrix);
+
+        result[i] = v.x;
+        result[i + 1] = v.y;
+        result[i + 2] = v.z;
+    }
+}
+
+#ifdef S3L_AVX2_TARGET
+/** Truncating division by S3L_FRACTIONS_PER_UNIT of 4 signed 64 bit values
+  (AVX2 has no 64 bit arithmetic shift). */
+S3L_AVX2_TARGET static inline __m256i _S3L_divideByUnitAVX2(__m256i v)
+{
+    __m256i negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(),v);
+
+    v = _mm256_add_epi64(v,
+      _mm256_and_si256(negative,_mm256_set1_epi64x(S3L_FRACTIONS_PER_UNIT - 1)));
+
+    /* The sign has to be taken again after rounding, values in
+      (-S3L_FRACTIONS_PER_UNIT, 0) end up as 0. */
+    negative = _mm256_cmpgt_epi64(_mm256_setzero_si256(),v);
+
+    return _mm256_or_si256(_mm256_srli_epi64(v,9),_mm256_slli_epi64(negative,64 - 9));
+}
+
+/** Transforms 4 vertices at a time. Products are computed with 32x32 -> 64 bit
+  multiplies, so a group of vertices that doesn't fit into 32 bits is done by
+  the scalar code. Returns how many vertices were processed. */
+S3L_AVX2_TARGET inline uint32_t _S3L_transformVerticesAVX2(
+        const S3L_Unit *vertices,
+        uint32_t vertexCount,
+        S3L_Mat4 matrix,
+        S3L_Unit *result)
+{
+    static_assert(S3L_FRACTIONS_PER_UNIT == 512, "The AVX2 kernel divides by shifting.");
+
+    for (uint8_t col = 0; col < 3; ++col)
+        for (uint8_t row = 0; row < 3; ++row)
+            if (matrix[col][row] != (int32_t) matrix[col][row])
+                return 0;
+
+    __m256i m[3][4];
+
+    for (uint8_t col = 0; col < 3; ++col)
+        for (uint8_t row = 0; row < 4; ++row)
+            m[col][row] = _mm256_set1_epi64x(matrix[col][row]);
+
+    const __m256i bias = _mm256_set1_epi64x(0x80000000LL);
+    const long long *source = (const long long *) vertices;
+
+    uint32_t i = 0;
+
+    for (; i + 4 <= vertexCount; i += 4)
+    {
+        const __m256i *base = (const __m256i *) (source + i * 3);
+
+        /* x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 -> x0..x3, y0..y3, z0..z3 */
+        __m256i a = _mm256_loadu_si256(base);
+        __m256i b = _mm256_loadu_si256(base + 1);
+        __m256i c = _mm256_loadu_si256(base + 2);
+
+        __m256i x = _mm256_permute4x64_epi64(
+          _mm256_blend_epi32(_mm256_blend_epi32(a,b,0x30),c,0x0C),0x6C);
+        __m256i y = _mm256_permute4x64_epi64(
+          _mm256_blend_epi32(_mm256_blend_epi32(a,b,0xC3),c,0x30),0xB1);
+        __m256i z = _mm256_permute4x64_epi64(
+          _mm256_blend_epi32(_mm256_blend_epi32(a,b,0x0C),c,0xC3),0xC6);
+
+        __m256i outOfRange = _mm256_or_si256(
+          _mm256_srli_epi64(_mm256_add_epi64(x,bias),32),
+          _mm256_or_si256(
+            _mm256_srli_epi64(_mm256_add_epi64(y,bias),32),
+            _mm256_srli_epi64(_mm256_add_epi64(z,bias),32)));
+
+        if (!_mm256_testz_si256(outOfRange,outOfRange))
+        {
+            _S3L_transformVerticesScalar(vertices + i * 3,4,matrix,result + i * 3);
+            continue;
+        }
+
+        __m256i out[3];
+
+        for (uint8_t col = 0; col < 3; ++col)
+            out[col] = _mm256_add_epi64(
+              _mm256_add_epi64(
+                _S3L_divideByUnitAVX2(_mm256_mul_epi32(x,m[col][0])),
+                _S3L_divideByUnitAVX2(_mm256_mul_epi32(y,m[col][1]))),
+              _mm256_add_epi64(
+                _S3L_divideByUnitAVX2(_mm256_mul_epi32(z,m[col][2])),
+                m[col][3]));
+
+        // the same shuffle in reverse
+        x = _mm256_permute4x64_epi64(out[0],0x6C);
+        y = _mm256_permute4x64_epi64(out[1],0xB1);
+        z = _mm256_permute4x64_epi64(out[2],0xC6);
+
+        __m256i *target = (__m256i *) (result + i * 3);
+
+        _mm256_storeu_si256(target,
+          _mm256_blend_epi32(_mm256_blend_epi32(x,y,0x0C),z,0x30));
+        _mm256_storeu_si256(target + 1,
+          _mm256_blend_epi32(_mm256_blend_epi32(y,x,0x30),z,0x0C));
+        _mm256_storeu_si256(target + 2,
+          _mm256_blend_epi32(_mm256_blend_epi32(z,x,0x0C),y,0x30));
+    }
+
+    return i;
+}
+#endif
+
+/** Transforms vertices (3 values per vertex) by a matrix, giving the same
+  results as S3L_vec3Xmat4. */
+inline void S3L_transformVertices(
+        const S3L_Unit *vertices,
+        uint32_t vertexCount,
+        S3L_Mat4 matrix,
+        S3L_Unit *result)
+{
+    uint32_t done = 0;
+
+#ifdef S3L_AVX2_TARGET
+    static const int8_t hasAVX2 = S3L_AVX2_SUPPORTED() != 0;
+
+    if (hasAVX2)
+        done = _S3L_transformVerticesAVX2(vertices,vertexCount,matrix,result);
+#endif
+
+    _S3L_transformVerticesScalar(vertices + done * 3,vertexCount - done,matrix,
+                                 result + done * 3);
+}
+
+/** Scratch space for the transformed vertices of models without a vertex
+  cache, grows to the largest model drawn in the context. */
+#define _S3L_vertexScratch (S3L_context->vertexScratch)
+#define _S3L_vertexScratchCapacity (S3L_context->vertexScratchCapacity)
+
+/** Returns the model's vertices transformed by the final (world and camera)
+  matrix. These come from the model's vertex cache if it has one (updating it if
+  needed), otherwise from scratch space that's only valid until the next call.
+  Returns 0 if no memory could be allocated. */
+inline const S3L_Unit *_S3L_transformModelVertices(
+        const S3L_Model3D *model,
+        S3L_Mat4 projectionMatrix)
+{
+    S3L_VertexCache *cache = model->vertexCache;
+
+    if (cache != 0 && _S3L_vertexCacheClaim(cache))
+    {
+        if (!cache->valid ||
+            memcmp(cache->matrix,projectionMatrix,sizeof(S3L_Mat4)) != 0)
+        {
+            memcpy(cache->matrix,projectionMatrix,sizeof(S3L_Mat4));
+            S3L_transformVertices(model->vertices,model->vertexCount,
+                                  projectionMatrix,cache->vertices);
+            cache->valid = 1;
+        }
+
+        return cache->vertices;
+    }
+
+    uint32_t size = (uint32_t) model->vertexCount * 3;
+
+    if (size > _S3L_vertexScratchCapacity)
+    {
+        std::free(_S3L_vertexScratch);
+        _S3L_vertexScratch = (S3L_Unit *) std::malloc(size * sizeof(S3L_Unit));
+        _S3L_vertexScratchCapacity = _S3L_vertexScratch != nullptr ? size : 0;
+
+        if (_S3L_vertexScratch == nullptr)
+            return 0;
+    }
+
+    S3L_transformVertices(model->vertices,model->vertexCount,projectionMatrix,
+                          _S3L_vertexScratch);
+
+    return _S3L_vertexScratch;
+}
+
 inline void _S3L_projectVertex(
         const S3L_Model3D *model,
         S3L_Index triangleIndex,
         uint8_t vertex,
         S3L_Mat4 projectionMatrix,
+        const S3L_Unit *transformedVertices,
         S3L_Vec4 *result)
 {
     uint32_t vertexIndex = model->triangles[triangleIndex * 3 + vertex] * 3;
 
+    if (transformedVertices != 0)
+    {
+        const S3L_Unit *v = transformedVertices + vertexIndex;
+
+        result->x = v[0];
+        result->y = v[1];
+        result->z = v[2];
+        result->w = result->z;
+        return;
+    }
+
     result->x = model->vertices[vertexIndex];
     result->y = model->vertices[vertexIndex + 1];
     result->z = model->vertices[vertexIndex + 2];
@@ -2715,12 +3236,16 @@ inline void _S3L_projectTriangle(
         const S3L_Model3D *model,
         S3L_Index triangleIndex,
         S3L_Mat4 matrix,
+        const S3L_Unit *transformedVertices,
         uint32_t focalLength,
         S3L_Vec4 transformed[6])
 {
-    _S3L_projectVertex(model,triangleIndex,0,matrix,&(transformed[0]));
-    _S3L_projectVertex(model,triangleIndex,1,matrix,&(transformed[1]));
-    _S3L_projectVertex(model,triangleIndex,2,matrix,&(transformed[2]));
+    _S3L_projectVertex(model,triangleIndex,0,matrix,transformedVertices,
+                       &(transformed[0]));
+    _S3L_projectVertex(model,triangleIndex,1,matrix,transformedVertices,
+                       &(transformed[1]));
+    _S3L_projectVertex(model,triangleIndex,2,matrix,transformedVertices,
+                       &(transformed[2]));
 
     _S3L_projectedTriangleState = 0;
 
@@ -2850,6 +3375,9 @@ inline void S3L_drawScene(S3L_Scene scene)
     const S3L_Model3D *model;
     S3L_Index modelIndex, triangleIndex;
 
+    if (!S3L_zBufferReady())
+      return;
+
     S3L_makeCameraMatrix(scene.camera.transform,matCamera);
 
 #if S3L_SORT != 0
@@ -2881,6 +3409,8 @@ inline void S3L_drawScene(S3L_Scene scene)
         }
 
         S3L_mat4Xmat4(matFinal,matCamera);
+        const S3L_Unit *transformedVertices =
+                _S3L_transformModelVertices(&(scene.models[modelIndex]),matFinal);
 
         S3L_Index triangleCount = scene.models[modelIndex].triangleCount;
 
@@ -2890,11 +3420,10 @@ inline void S3L_drawScene(S3L_Scene scene)
 
         while (triangleIndex < triangleCount)
         {
-            /* Some kind of cache could be used in theory to not project perviously
-               already projected vertices, but after some testing this was abandoned,
-               no gain was seen. */
+            /* Vertices have been transformed above, once per vertex rather than
+               once per triangle corner. */
 
-            _S3L_projectTriangle(model,triangleIndex,matFinal,
+            _S3L_projectTriangle(model,triangleIndex,matFinal,transformedVertices,
                                  scene.camera.focalLength,transformed);
 
             if (S3L_triangleIsVisible(transformed[0],transformed[1],transformed[2],
@@ -2991,8 +3520,8 @@ inline void S3L_drawScene(S3L_Scene scene)
        require a lot of memory, which for small resolutions could be even
        worse than z-bufer. So this seems to be the best way memory-wise. */
 
-    _S3L_projectTriangle(model,triangleIndex,matFinal,scene.camera.focalLength,
-      transformed);
+    _S3L_projectTriangle(model,triangleIndex,matFinal,0,
+      scene.camera.focalLength,transformed);
 
     S3L_drawTriangle(transformed[0],transformed[1],transformed[2],modelIndex,
       triangleIndex);
@@ -0,0 +1,140 @@
+#ifndef PROJECT3_TEST_SUBCELL_BUFFER_HPP
+#define PROJECT3_TEST_SUBCELL_BUFFER_HPP
+
+#include <array>
+#include <bit>
+#include <vector>
+
+#include <render/core.hpp>
+
+namespace render {
+    /**
+     * The glyph for every coverage pattern of a 2x4 block of subpixels, bit `row * 2 + column`.
+     * Patterns close to a half or full block (at most one subpixel off) get that block,
+     * anything more scattered gets the shade matching its coverage.
+     */
+    inline constexpr auto coverage_glyphs = [] {
+        struct Shape {
+            std::uint8_t mask;
+            char glyph;
+        };
+        constexpr Shape shapes[] {
+            { 0x00, ' ' },
+            { 0xFF, char(219) },    // █
+            { 0x0F, char(223) },    // ▀
+            { 0xF0, char(220) },    // ▄
+            { 0x55, char(221) },    // ▌
+            { 0xAA, char(222) },    // ▐
+        };
+        constexpr char shades[] { ' ', ' ', char(176), char(176), char(177), char(177), char(178), char(178), char(219) };
+
+        std::array<char, 256> table {};
+        for(unsigned mask = 0; mask < 256; ++mask) {
+            int best = 9;
+            for(const Shape& shape : shapes) {
+                const int distance = std::popcount(mask ^ shape.mask);
+                if(distance < best) {
+                    best = distance;
+                    table[mask] = shape.glyph;
+                }
+            }
+            if(best > 1) table[mask] = shades[std::popcount(mask)];
+        }
+        return table;
+    }();
+
+    enum class SubcellMode {
+        half_block,     // 1x2 subpixels per cell, the rasterizer's native resolution
+        block_2x4,      // 2x4 subpixels per cell
+    };
+
+    /**
+     * Rasterization target with several subpixels per character cell.
+     * On resolve, cells fully covered are shaded like before, while cells on the edge of
+     * geometry get the block glyph matching their coverage. Silhouettes get subcell precision
+     * without sending more than one byte per cell.
+     */
+    struct SubcellBuffer {
+        /// Rasterizer resolution for `cells` character cells.
+        NODISCARD static api::Coords get_resolution(api::Coords cells, SubcellMode mode) NOEXCEPT {
+            return (mode == SubcellMode::half_block) ? cells * api::Coords { 1, 2 } : cells * api::Coords { 2, 4 };
+        }
+
+        /// Matches the buffer to `cells`, call before rasterizing.
+        void begin(api::Coords cells, SubcellMode mode) NOEXCEPT {
+            const api::Coords size = get_resolution(cells, mode);
+            if(mode != _mode or size.x != _size.x or size.y != _size.y) {
+                _mode = mode;
+                _cells = cells;
+                _size = size;
+                _samples.assign(std::size_t(size.x) * size.y, { empty_palette, 0 });
+            }
+
+            if(mode == SubcellMode::half_block) {
+                _bits[0][0] = 0x0F;
+                _bits[1][0] = 0xF0;
+            }
+            else {
+                for(int y = 0; y < 4; ++y)
+                    for(int x = 0; x < 2; ++x)
+                        _bits[y][x] = std::uint8_t(1u << (y * 2 + x));
+            }
+        }
+
+        void write_span(int x, int y, int length, std::uint8_t palette, std::uint8_t luminance) NOEXCEPT {
+            std::fill_n(_samples.data() + std::size_t(y) * _size.x + x, length, Sample { palette, luminance });
+        }
+
+        /// Writes every cell with anything in it to `dst`, then forgets the samples.
+        void resolve(char* dst, int stride) NOEXCEPT {
+            const int sub_x = _size.x / _cells.x;
+            const int sub_y = _size.y / _cells.y;
+
+            for(int cy = 0; cy < _cells.y; ++cy) {
+                Sample* rows = _samples.data() + std::size_t(cy * sub_y) * _size.x;
+                char* out = dst + std::size_t(cy) * stride;
+
+                for(int cx = 0; cx < _cells.x; ++cx) {
+                    std::uint8_t mask = 0, palette = empty_palette;
+                    int luminance = 0, count = 0;
+
+                    for(int y = 0; y < sub_y; ++y) {
+                        Sample* s = rows + std::size_t(y) * _size.x + cx * sub_x;
+                        for(int x = 0; x < sub_x; ++x, ++s) {
+                            if(s->palette == empty_palette) continue;
+                            if(palette == empty_palette) palette = s->palette;
+                            mask |= _bits[y][x];
+                            luminance += s->luminance;
+                            ++count;
+                            s->palette = empty_palette;
+                        }
+                    }
+
+                    if(mask == 0xFF) {
+                        out[cx] = glyph_table[palette][luminance / count];
+                    }
+                    else if(coverage_glyphs[mask] != ' ') {
+                        out[cx] = coverage_glyphs[mask];
+                    }
+                }
+            }
+        }
+
+    private:
+        static constexpr std::uint8_t empty_palette = 0xFF;
+        static_assert(palette_count < empty_palette);
+
+        struct Sample {
+            std::uint8_t palette;
+            std::uint8_t luminance;
+        };
+
+    private:
+        std::vector<Sample> _samples;
+        std::uint8_t _bits[4][2] {};        // Coverage bits of every subpixel in a cell
+        SubcellMode _mode = SubcellMode::half_block;
+        api::Coords _cells {}, _size {};
+    };
+}
+
+#endif //PROJECT3_TEST_SUBCELL_BUFFER_HPP
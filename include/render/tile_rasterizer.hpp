@@ -0,0 +1,178 @@
+#ifndef PROJECT3_TEST_TILE_RASTERIZER_HPP
+#define PROJECT3_TEST_TILE_RASTERIZER_HPP
+
+#include <algorithm>
+#include <vector>
+
+#include <render/small3dlib.hpp>
+#include <api/detail/worker_pool.hpp>
+
+static_assert(S3L_SORT == 0, "The tile rasterizer only supports unsorted (z-buffered) drawing.");
+
+namespace render {
+    /**
+     * A projected triangle with everything needed to rasterize it later.
+     */
+    struct BinnedTriangle {
+        S3L_Vec4 points[3];
+        S3L_Vec4 remap[3];
+        S3L_Index model_index;
+        S3L_Index triangle_index;
+        S3L_ScreenCoord top, bottom;
+        uint8_t projected_state;
+    };
+
+    /**
+     * Drop-in replacement for S3L_drawScene that rasterizes on a worker pool.
+     * The screen is split into full width bands; every band is drawn by one thread,
+     * which owns those rows of the z-buffer and framebuffer, and draws its triangles in
+     * submission order. This gives exactly the same output as the serial path.
+     */
+    struct TileRasterizer {
+        /// Bands always cover an even amount of rows, since two rows are packed into one cell
+        static constexpr int band_alignment = 2;
+        static constexpr int bands_per_thread = 4;
+        static constexpr std::size_t min_parallel_triangles = 64;
+
+        explicit TileRasterizer(unsigned workers = api::WorkerPool::default_worker_count()) : _pool(workers) {}
+
+        void draw_scene(const S3L_Scene& scene) NOEXCEPT {
+            if(not S3L_zBufferReady()) return;
+            _bin_scene(scene);
+            if(_triangles.empty()) return;
+
+            /// Not worth waking the pool, draw everything in one pass
+            if(_triangles.size() < min_parallel_triangles or not _pool.size()) {
+                for(const BinnedTriangle& tri : _triangles) _draw_triangle(tri, 0, S3L_RESOLUTION_Y);
+                return;
+            }
+
+            /// Workers draw into the caller's context
+            S3L_Context* context = S3L_context;
+            _pool.parallel_for(_band_count, [this, context](int band) {
+                S3L_Context* previous = S3L_context;
+                S3L_context = context;
+                _draw_band(band);
+                S3L_context = previous;
+            });
+        }
+
+        NODISCARD unsigned thread_count() CNOEXCEPT {
+            return _pool.size() + 1;
+        }
+
+    private:
+        void _update_bands() NOEXCEPT {
+            const int rows = S3L_RESOLUTION_Y;
+            const int target = static_cast<int>(thread_count() * bands_per_thread);
+            int height = (rows + target - 1) / target;
+            height = std::max(band_alignment, ((height + band_alignment - 1) / band_alignment) * band_alignment);
+
+            _band_height = height;
+            _band_count = std::max(1, (rows + height - 1) / height);
+            _bins.resize(_band_count);
+        }
+
+        void _push_triangle(const S3L_Vec4* points, S3L_Index model_index, S3L_Index triangle_index,
+                            uint8_t state, const S3L_Vec4* remap) NOEXCEPT {
+            BinnedTriangle tri;
+            std::copy(points, points + 3, tri.points);
+        #if S3L_NEAR_CROSS_STRATEGY == 3
+            std::copy(remap, remap + 3, tri.remap);
+        #else
+            S3L_UNUSED(remap);
+        #endif
+            tri.model_index = model_index;
+            tri.triangle_index = triangle_index;
+            tri.projected_state = state;
+            tri.top = std::min({ points[0].y, points[1].y, points[2].y });
+            tri.bottom = std::max({ points[0].y, points[1].y, points[2].y });
+
+            /// The bottom row is never rasterized, see the rasterization rules in small3dlib
+            const int first = std::max(0, static_cast<int>(tri.top)) / _band_height;
+            const int last = std::min(_band_count - 1, (static_cast<int>(tri.bottom) - 1) / _band_height);
+            if(tri.bottom <= 0 or first > last) return;
+
+            const auto index = static_cast<uint32_t>(_triangles.size());
+            _triangles.push_back(tri);
+            for(int band = first; band <= last; ++band) {
+                _bins[band].push_back(index);
+            }
+        }
+
+        /**
+         * Projects every visible triangle of the scene and bins it into the bands it covers.
+         * Mirrors the unsorted path of S3L_drawScene.
+         */
+        void _bin_scene(const S3L_Scene& scene) NOEXCEPT {
+            _update_bands();
+            _triangles.clear();
+            for(auto& bin : _bins) bin.clear();
+
+            S3L_Mat4 mat_final, mat_camera;
+            S3L_Vec4 transformed[6];
+            S3L_makeCameraMatrix(scene.camera.transform, mat_camera);
+
+            for(S3L_Index model_index = 0; model_index < scene.modelCount; ++model_index) {
+                const S3L_Model3D* model = &scene.models[model_index];
+                if(not model->config.visible) continue;
+
+                if(model->customTransformMatrix == 0) {
+                    S3L_makeWorldMatrix(model->transform, mat_final);
+                }
+                else {
+                    S3L_Mat4* m = model->customTransformMatrix;
+                    for(int j = 0; j < 4; ++j)
+                        for(int i = 0; i < 4; ++i)
+                            mat_final[i][j] = (*m)[i][j];
+                }
+
+                S3L_mat4Xmat4(mat_final, mat_camera);
+                const S3L_Unit* view_vertices = _S3L_transformModelVertices(model, mat_final);
+
+                for(S3L_Index triangle_index = 0; triangle_index < model->triangleCount; ++triangle_index) {
+                    _S3L_projectTriangle(model, triangle_index, mat_final, view_vertices,
+                                         scene.camera.focalLength, transformed);
+                    if(not S3L_triangleIsVisible(transformed[0], transformed[1], transformed[2],
+                                                 model->config.backfaceCulling)) continue;
+
+                #if S3L_NEAR_CROSS_STRATEGY == 3
+                    const S3L_Vec4* remap = _S3L_triangleRemapBarycentrics;
+                #else
+                    const S3L_Vec4* remap = nullptr;
+                #endif
+
+                    const uint8_t state = _S3L_projectedTriangleState;
+                    _push_triangle(transformed, model_index, triangle_index, state, remap);
+                    if(state == 2) {
+                        _push_triangle(transformed + 3, model_index, triangle_index, state, remap ? remap + 3 : nullptr);
+                    }
+                }
+            }
+        }
+
+        void _draw_band(int band) NOEXCEPT {
+            const auto top = static_cast<S3L_ScreenCoord>(band * _band_height);
+            const auto bottom = static_cast<S3L_ScreenCoord>(top + _band_height);
+
+            for(uint32_t index : _bins[band]) {
+                _draw_triangle(_triangles[index], top, bottom);
+            }
+        }
+
+        static void _draw_triangle(const BinnedTriangle& tri, S3L_ScreenCoord top, S3L_ScreenCoord bottom) NOEXCEPT {
+            _S3L_drawTriangleRows(tri.points[0], tri.points[1], tri.points[2],
+                                  tri.model_index, tri.triangle_index, top, bottom,
+                                  tri.projected_state, tri.remap);
+        }
+
+    private:
+        api::WorkerPool _pool;
+        std::vector<BinnedTriangle> _triangles;
+        std::vector<std::vector<uint32_t>> _bins;
+        int _band_height = band_alignment;
+        int _band_count = 1;
+    };
+}
+
+#endif //PROJECT3_TEST_TILE_RASTERIZER_HPP
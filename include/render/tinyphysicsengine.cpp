@@ -1,5 +1,9 @@
 #include "tinyphysicsengine.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
 #define TPE_ARRAY_TO_VEC3(input) TPE_Vec3 { input[0], input[1], input[2] }
 
 static inline TPE_Unit TPE_abs(TPE_Unit x);
@@ -10,8 +14,9 @@ static inline TPE_Unit TPE_nonZero(TPE_Unit x);
 //------------------------------------------------------------------------------
 // privates:
 
-uint16_t _TPE_body1Index, _TPE_body2Index, _TPE_joint1Index, _TPE_joint2Index;
-TPE_CollisionCallback _TPE_collisionCallback;
+/* Per thread, so islands can be stepped in parallel. */
+thread_local uint16_t _TPE_body1Index, _TPE_body2Index, _TPE_joint1Index, _TPE_joint2Index;
+thread_local TPE_CollisionCallback _TPE_collisionCallback;
 
 TPE_Unit TPE_nonZero(TPE_Unit x)
 {
@@ -296,190 +301,630 @@ void TPE_bodyDeactivate(TPE_Body *body)
     body->flags |= TPE_BODY_FLAG_DEACTIVATED;
 }
 
-void TPE_worldStep(TPE_World *world)
+/* Broadphase of a world step: for every body, the bodies it may touch during
+   the step, sorted by index (CSR layout, body i's candidates are
+   _TPE_candidates[_TPE_candidateStart[i]] to [_TPE_candidateStart[i + 1]]). */
+std::vector<uint32_t> _TPE_candidateStart, _TPE_candidateFill;
+std::vector<uint16_t> _TPE_candidates;
+
+/* Current AABB of every body, recomputed whenever a body is moved (the body
+   being stepped only once its step is done). */
+std::vector<TPE_Vec3> _TPE_aabbMin, _TPE_aabbMax;
+
+/* Bounds grown by the broadphase margin, with the sweep axis as x, by body
+   and in sweep order (min and max interleaved). */
+std::vector<TPE_Vec3> _TPE_sweepMin, _TPE_sweepMax, _TPE_sweepSorted;
+std::vector<uint16_t> _TPE_sweepOrder;
+std::vector<uint32_t> _TPE_pairs; // body1 << 16 | body2
+uint8_t _TPE_sweepAxis;
+
+/* Bodies whose AABB has left their grown bounds during the step, which are
+   tested against every body for the rest of it. */
+std::vector<uint8_t> _TPE_escaped;
+uint16_t _TPE_escapedCount;
+
+/* The sweep always runs along x, so the chosen axis is rotated there. */
+static inline TPE_Vec3 _TPE_sweepRotate(TPE_Vec3 v)
 {
-    _TPE_collisionCallback = world->collisionCallback;
+    return _TPE_sweepAxis == 0 ? v :
+        (_TPE_sweepAxis == 1 ? TPE_vec3(v.y,v.z,v.x) : TPE_vec3(v.z,v.x,v.y));
+}
 
-    for (uint16_t i = 0; i < world->bodyCount; ++i)
+/* Finds the pairs of bodies that may collide during the next step with a
+   sweep and prune along the axis the bodies are most spread out on. Each
+   body's AABB is grown by a margin for how far its joints usually move before
+   the pair is tested: their velocity, plus the pushes of earlier collisions
+   this step, estimated from the fastest and the largest joint in the world.
+   Bodies that still end up outside their grown bounds are caught by
+   _TPE_checkGrownBounds.
+
+   Pairs are stored for both bodies, since whether a pair is tested depends on
+   which of the two is asleep at that point of the step. */
+void _TPE_broadphase(const TPE_World *world)
+{
+    uint16_t count = world->bodyCount;
+
+    _TPE_aabbMin.resize(count);
+    _TPE_aabbMax.resize(count);
+    _TPE_escaped.assign(count,0);
+    _TPE_escapedCount = 0;
+    _TPE_sweepMin.resize(count);
+    _TPE_sweepMax.resize(count);
+    _TPE_sweepOrder.resize(count);
+    _TPE_candidateStart.assign(count + 1,0);
+    _TPE_pairs.clear();
+
+    TPE_Unit maxSize = 0, maxSpeed = 0;
+
+    for (uint16_t i = 0; i < count; ++i)
     {
-        TPE_Body *body = world->bodies + i;
+        const TPE_Body *body = world->bodies + i;
 
-        if (body->flags & (TPE_BODY_FLAG_DEACTIVATED | TPE_BODY_FLAG_DISABLED))
-            continue;
+        TPE_bodyGetAABB(body,&_TPE_aabbMin[i],&_TPE_aabbMax[i]);
+        _TPE_sweepOrder[i] = i;
 
-        TPE_Joint *joint = body->joints, *joint2;
+        for (uint16_t j = 0; j < body->jointCount; ++j)
+        {
+            const TPE_Joint *joint = body->joints + j;
 
-        TPE_Vec3 origPos = body->joints[0].position;
+            maxSize = TPE_max(maxSize,TPE_JOINT_SIZE(*joint));
 
-        for (uint16_t j = 0; j < body->jointCount; ++j) // apply velocities
+            for (uint8_t k = 0; k < 3; ++k)
+                maxSpeed = TPE_max(maxSpeed,TPE_abs(joint->velocity[k]));
+        }
+    }
+
+    TPE_Unit m = 2 * (maxSpeed + maxSize);
+    TPE_Vec3 margin = TPE_vec3(m,m,m);
+
+    // pick the axis with the largest variance of the AABB centers
+
+    double sum[3] = {0,0,0}, sumSq[3] = {0,0,0};
+
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        TPE_Vec3 c = TPE_vec3Plus(_TPE_aabbMin[i],_TPE_aabbMax[i]);
+        double v[3] = {(double) c.x, (double) c.y, (double) c.z};
+
+        for (uint8_t k = 0; k < 3; ++k)
         {
-            // non-rotating bodies will copy the 1st joint's velocity
+            sum[k] += v[k];
+            sumSq[k] += v[k] * v[k];
+        }
+    }
 
-            if (body->flags & TPE_BODY_FLAG_NONROTATING)
-                for (uint8_t k = 0; k < 3; ++k)
-                    joint->velocity[k] = body->joints[0].velocity[k];
+    _TPE_sweepAxis = 0;
+    double best = -1;
 
-            joint->position.x += joint->velocity[0];
-            joint->position.y += joint->velocity[1];
-            joint->position.z += joint->velocity[2];
+    for (uint8_t k = 0; k < 3; ++k)
+    {
+        double variance = sumSq[k] - sum[k] * sum[k] / TPE_max(count,1);
 
-            joint++;
+        if (variance > best)
+        {
+            best = variance;
+            _TPE_sweepAxis = k;
         }
+    }
 
-        TPE_Connection *connection = body->connections;
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        _TPE_sweepMin[i] = _TPE_sweepRotate(TPE_vec3Minus(_TPE_aabbMin[i],margin));
+        _TPE_sweepMax[i] = _TPE_sweepRotate(TPE_vec3Plus(_TPE_aabbMax[i],margin));
+    }
 
-        TPE_Vec3 aabbMin, aabbMax;
+    std::sort(_TPE_sweepOrder.begin(),_TPE_sweepOrder.end(),
+        [](uint16_t a, uint16_t b)
+        {
+            return _TPE_sweepMin[a].x < _TPE_sweepMin[b].x;
+        });
 
-        TPE_bodyGetAABB(body,&aabbMin,&aabbMax);
+    // bounds in sweep order, so the sweep reads them front to back
 
-        _TPE_body1Index = i;
+    _TPE_sweepSorted.resize(2 * count);
 
-        _TPE_body2Index = _TPE_body1Index;
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        _TPE_sweepSorted[2 * i] = _TPE_sweepMin[_TPE_sweepOrder[i]];
+        _TPE_sweepSorted[2 * i + 1] = _TPE_sweepMax[_TPE_sweepOrder[i]];
+    }
 
-        uint8_t collided =
-                TPE_bodyEnvironmentResolveCollision(body,world->environmentFunction);
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        const TPE_Vec3 min1 = _TPE_sweepSorted[2 * i], max1 = _TPE_sweepSorted[2 * i + 1];
 
-        if (body->flags & TPE_BODY_FLAG_NONROTATING)
+        for (uint16_t j = i + 1; j < count; ++j)
         {
-            /* Non-rotating bodies may end up still colliding after environment coll
-            resolvement (unlike rotating bodies where each joint is ensured separately
-            to not collide). So if still in collision, we try a few more times. If not
-            successful, we simply undo any shifts we've done. This should absolutely
-            prevent any body escaping out of environment bounds. */
+            const TPE_Vec3 &min2 = _TPE_sweepSorted[2 * j], &max2 = _TPE_sweepSorted[2 * j + 1];
 
-            for (uint8_t i = 0; i < TPE_NONROTATING_COLLISION_RESOLVE_ATTEMPTS; ++i)
-            {
-                if (!collided)
-                    break;
+            if (min2.x > max1.x)
+                break;
 
-                collided =
-                        TPE_bodyEnvironmentResolveCollision(body,world->environmentFunction);
-            }
+            if (min2.y > max1.y || min1.y > max2.y ||
+                min2.z > max1.z || min1.z > max2.z)
+                continue;
+
+            uint16_t b1 = _TPE_sweepOrder[i], b2 = _TPE_sweepOrder[j];
+
+            _TPE_pairs.push_back((uint32_t(b1) << 16) | b2);
+            _TPE_candidateStart[b1 + 1]++;
+            _TPE_candidateStart[b2 + 1]++;
+        }
+    }
+
+    for (uint16_t i = 0; i < count; ++i)
+        _TPE_candidateStart[i + 1] += _TPE_candidateStart[i];
+
+    _TPE_candidates.resize(_TPE_candidateStart[count]);
+    _TPE_candidateFill.assign(_TPE_candidateStart.begin(),_TPE_candidateStart.end() - 1);
+
+    for (uint32_t pair : _TPE_pairs)
+    {
+        uint16_t b1 = pair >> 16, b2 = pair & 0xffff;
+
+        _TPE_candidates[_TPE_candidateFill[b1]++] = b2;
+        _TPE_candidates[_TPE_candidateFill[b2]++] = b1;
+    }
+
+    // bodies are resolved in index order, like when testing all of them
+
+    for (uint16_t i = 0; i < count; ++i)
+        std::sort(_TPE_candidates.begin() + _TPE_candidateStart[i],
+                  _TPE_candidates.begin() + _TPE_candidateStart[i + 1]);
+}
+
+/* Bodies whose collision callback is due at the end of a step stepped in
+   islands (see TPE_worldStepEnd). */
+std::vector<uint8_t> _TPE_callbackPending;
+std::vector<TPE_Vec3> _TPE_callbackSpeed;
+
+/* Islands of the current step, bodies sorted by index within each, and
+   groups of consecutive islands handed out as one job (CSR layout like the
+   broadphase candidates). */
+std::vector<uint16_t> _TPE_islandParent;
+std::vector<uint16_t> _TPE_islandBodies;
+std::vector<uint32_t> _TPE_islandStart, _TPE_islandFill;
+std::vector<uint16_t> _TPE_groupStart;
 
-            if (collided &&
-                TPE_bodyEnvironmentCollide(body,world->environmentFunction))
-                TPE_bodyMoveBy(body,TPE_vec3Minus(origPos,body->joints[0].position));
+/* What a step changes in the bodies, saved before stepping in islands so the
+   step can be redone serially. */
+typedef struct
+{
+  uint8_t flags;
+  uint8_t deactivateCount;
+  bool previouslyCollided;
+} _TPE_BodyState;
+
+std::vector<_TPE_BodyState> _TPE_savedBodies;
+std::vector<TPE_Joint> _TPE_savedJoints;
+
+/* Set by the first body that leaves its grown bounds during a step in
+   islands, after which the step is redone serially (see TPE_worldStepEnd). */
+std::atomic<uint8_t> _TPE_islandsAbandoned;
+
+/* Called whenever body i's AABB has been recomputed. Two bodies inside their
+   grown bounds can only touch if they are broadphase candidates, a body
+   outside of them could reach any body and is marked to be tested against
+   all of them. In islands those bodies may belong to another thread, so the
+   islands are abandoned instead and 0 is returned. */
+uint8_t _TPE_checkGrownBounds(uint16_t i, TPE_Vec3 aabbMin, TPE_Vec3 aabbMax,
+                              uint8_t inIslands)
+{
+    if (_TPE_escaped[i])
+        return 1;
+
+    aabbMin = _TPE_sweepRotate(aabbMin);
+    aabbMax = _TPE_sweepRotate(aabbMax);
+
+    if (aabbMin.x >= _TPE_sweepMin[i].x && aabbMax.x <= _TPE_sweepMax[i].x &&
+        aabbMin.y >= _TPE_sweepMin[i].y && aabbMax.y <= _TPE_sweepMax[i].y &&
+        aabbMin.z >= _TPE_sweepMin[i].z && aabbMax.z <= _TPE_sweepMax[i].z)
+        return 1;
+
+    if (inIslands)
+    {
+        _TPE_islandsAbandoned.store(1,std::memory_order_relaxed);
+        return 0;
+    }
+
+    _TPE_escaped[i] = 1;
+    _TPE_escapedCount++;
+
+    return 1;
+}
+
+/* Tests body i, with the AABB it got after moving, against body j the way
+   the loop over all bodies of TPE_worldStep always has. Returns 0 if the
+   islands had to be abandoned. */
+uint8_t _TPE_bodyPairStep(TPE_World *world, uint16_t i, uint16_t j,
+                       TPE_Vec3 aabbMin, TPE_Vec3 aabbMax, uint8_t inIslands)
+{
+    TPE_Body *body = world->bodies + i;
+
+    if (j > i || (world->bodies[j].flags & TPE_BODY_FLAG_DEACTIVATED))
+    {
+        // firstly quick-check collision of body AA bounding boxes
+
+        _TPE_body2Index = j;
+
+        if (TPE_checkOverlapAABB(aabbMin,aabbMax,_TPE_aabbMin[j],_TPE_aabbMax[j]) &&
+            TPE_bodiesResolveCollision(body,world->bodies + j,
+                                       world->environmentFunction))
+        {
+            TPE_bodyGetAABB(world->bodies + j,&_TPE_aabbMin[j],&_TPE_aabbMax[j]);
+
+            if (!_TPE_checkGrownBounds(j,_TPE_aabbMin[j],_TPE_aabbMax[j],inIslands))
+                return 0;
+
+            TPE_bodyActivate(body);
+            body->deactivateCount = TPE_LIGHT_DEACTIVATION;
+
+            TPE_bodyActivate(world->bodies + j);
+            world->bodies[j].deactivateCount = TPE_LIGHT_DEACTIVATION;
         }
-        else // normal, rotating bodies
+    }
+
+    return 1;
+}
+
+/* Moves body i by one step and resolves its collisions, the body of the
+   TPE_worldStep loop. Only touches body i and bodies in its broadphase
+   candidates, unless a body has left its grown bounds. Returns 0 if the
+   islands had to be abandoned. */
+uint8_t _TPE_bodyStep(TPE_World *world, uint16_t i, uint8_t inIslands)
+{
+    TPE_Body *body = world->bodies + i;
+
+    if (body->flags & (TPE_BODY_FLAG_DEACTIVATED | TPE_BODY_FLAG_DISABLED))
+        return 1;
+
+    TPE_Joint *joint = body->joints, *joint2;
+
+    TPE_Vec3 origPos = body->joints[0].position;
+
+    if (body->flags & TPE_BODY_FLAG_NONROTATING) // apply velocities
+    {
+        // non-rotating bodies will copy the 1st joint's velocity
+
+        TPE_UnitReduced v[3] = {joint->velocity[0],joint->velocity[1],joint->velocity[2]};
+
+        for (uint16_t j = 0; j < body->jointCount; ++j)
         {
-            TPE_Unit bodyTension = 0;
+            joint->velocity[0] = v[0];
+            joint->velocity[1] = v[1];
+            joint->velocity[2] = v[2];
 
-            for (uint16_t j = 0; j < body->connectionCount; ++j) // joint tension
-            {
-                joint  = &(body->joints[connection->joint1]);
-                joint2 = &(body->joints[connection->joint2]);
+            joint->position.x += v[0];
+            joint->position.y += v[1];
+            joint->position.z += v[2];
 
-                TPE_Vec3 dir = TPE_vec3Minus(joint2->position,joint->position);
+            joint++;
+        }
+    }
+    else
+        for (uint16_t j = 0; j < body->jointCount; ++j)
+        {
+            joint->position.x += joint->velocity[0];
+            joint->position.y += joint->velocity[1];
+            joint->position.z += joint->velocity[2];
 
-                TPE_Unit tension = TPE_connectionTension(TPE_LENGTH(dir),
-                                                         connection->length);
+            joint++;
+        }
 
-                bodyTension += tension > 0 ? tension : -tension;
+    TPE_Connection *connection = body->connections;
 
-                if (tension > TPE_TENSION_ACCELERATION_THRESHOLD ||
-                    tension < -1 * TPE_TENSION_ACCELERATION_THRESHOLD)
-                {
-                    TPE_vec3Normalize(&dir);
+    TPE_Vec3 aabbMin, aabbMax;
 
-                    if (tension > TPE_TENSION_GREATER_ACCELERATION_THRESHOLD ||
-                        tension < -1 * TPE_TENSION_GREATER_ACCELERATION_THRESHOLD)
-                    {
-                        /* apply twice the acceleration after a second threshold, not so
-                           elegant but seems to work :) */
-                        dir.x *= 2;
-                        dir.y *= 2;
-                        dir.z *= 2;
-                    }
+    TPE_bodyGetAABB(body,&aabbMin,&aabbMax);
 
-                    dir.x /= TPE_TENSION_ACCELERATION_DIVIDER;
-                    dir.y /= TPE_TENSION_ACCELERATION_DIVIDER;
-                    dir.z /= TPE_TENSION_ACCELERATION_DIVIDER;
+    if (!_TPE_checkGrownBounds(i,aabbMin,aabbMax,inIslands))
+        return 0;
 
-                    if (tension < 0)
-                    {
-                        dir.x *= -1;
-                        dir.y *= -1;
-                        dir.z *= -1;
-                    }
+    _TPE_body1Index = i;
 
-                    joint->velocity[0] += dir.x;
-                    joint->velocity[1] += dir.y;
-                    joint->velocity[2] += dir.z;
+    _TPE_body2Index = _TPE_body1Index;
 
-                    joint2->velocity[0] -= dir.x;
-                    joint2->velocity[1] -= dir.y;
-                    joint2->velocity[2] -= dir.z;
-                }
+    uint8_t collided =
+            TPE_bodyEnvironmentResolveCollision(body,world->environmentFunction);
 
-                connection++;
-            }
+    if (body->flags & TPE_BODY_FLAG_NONROTATING)
+    {
+        /* Non-rotating bodies may end up still colliding after environment coll
+        resolvement (unlike rotating bodies where each joint is ensured separately
+        to not collide). So if still in collision, we try a few more times. If not
+        successful, we simply undo any shifts we've done. This should absolutely
+        prevent any body escaping out of environment bounds. */
+
+        for (uint8_t i = 0; i < TPE_NONROTATING_COLLISION_RESOLVE_ATTEMPTS; ++i)
+        {
+            if (!collided)
+                break;
+
+            collided =
+                    TPE_bodyEnvironmentResolveCollision(body,world->environmentFunction);
+        }
+
+        if (collided &&
+            TPE_bodyEnvironmentCollide(body,world->environmentFunction))
+            TPE_bodyMoveBy(body,TPE_vec3Minus(origPos,body->joints[0].position));
+    }
+    else // normal, rotating bodies
+    {
+        TPE_Unit bodyTension = 0;
+
+        for (uint16_t j = 0; j < body->connectionCount; ++j) // joint tension
+        {
+            joint  = &(body->joints[connection->joint1]);
+            joint2 = &(body->joints[connection->joint2]);
+
+            TPE_Vec3 dir = TPE_vec3Minus(joint2->position,joint->position);
 
-            if (body->connectionCount > 0)
+            TPE_Unit tension = TPE_connectionTension(TPE_LENGTH(dir),
+                                                     connection->length);
+
+            bodyTension += tension > 0 ? tension : -tension;
+
+            if (tension > TPE_TENSION_ACCELERATION_THRESHOLD ||
+                tension < -1 * TPE_TENSION_ACCELERATION_THRESHOLD)
             {
-                uint8_t hard = !(body->flags & TPE_BODY_FLAG_SOFT);
+                TPE_vec3Normalize(&dir);
 
-                if (hard)
+                if (tension > TPE_TENSION_GREATER_ACCELERATION_THRESHOLD ||
+                    tension < -1 * TPE_TENSION_GREATER_ACCELERATION_THRESHOLD)
                 {
-                    TPE_bodyReshape(body,world->environmentFunction);
+                    /* apply twice the acceleration after a second threshold, not so
+                       elegant but seems to work :) */
+                    dir.x *= 2;
+                    dir.y *= 2;
+                    dir.z *= 2;
+                }
 
-                    bodyTension /= body->connectionCount;
+                dir.x /= TPE_TENSION_ACCELERATION_DIVIDER;
+                dir.y /= TPE_TENSION_ACCELERATION_DIVIDER;
+                dir.z /= TPE_TENSION_ACCELERATION_DIVIDER;
 
-                    if (bodyTension > TPE_RESHAPE_TENSION_LIMIT)
-                        for (uint8_t k = 0; k < TPE_RESHAPE_ITERATIONS; ++k)
-                            TPE_bodyReshape(body,world->environmentFunction);
+                if (tension < 0)
+                {
+                    dir.x *= -1;
+                    dir.y *= -1;
+                    dir.z *= -1;
                 }
 
-                if (!(body->flags & TPE_BODY_FLAG_SIMPLE_CONN))
-                    TPE_bodyCancelOutVelocities(body,hard);
+                joint->velocity[0] += dir.x;
+                joint->velocity[1] += dir.y;
+                joint->velocity[2] += dir.z;
+
+                joint2->velocity[0] -= dir.x;
+                joint2->velocity[1] -= dir.y;
+                joint2->velocity[2] -= dir.z;
             }
+
+            connection++;
         }
 
-        for (uint16_t j = 0; j < world->bodyCount; ++j)
+        if (body->connectionCount > 0)
         {
-            if (j > i || (world->bodies[j].flags & TPE_BODY_FLAG_DEACTIVATED))
+            uint8_t hard = !(body->flags & TPE_BODY_FLAG_SOFT);
+
+            if (hard)
             {
-                // firstly quick-check collision of body AA bounding boxes
+                TPE_bodyReshape(body,world->environmentFunction);
 
-                TPE_Vec3 aabbMin2, aabbMax2;
-                TPE_bodyGetAABB(&world->bodies[j],&aabbMin2,&aabbMax2);
+                bodyTension /= body->connectionCount;
 
-                _TPE_body2Index = j;
+                if (bodyTension > TPE_RESHAPE_TENSION_LIMIT)
+                    for (uint8_t k = 0; k < TPE_RESHAPE_ITERATIONS; ++k)
+                        TPE_bodyReshape(body,world->environmentFunction);
+            }
 
-                if (TPE_checkOverlapAABB(aabbMin,aabbMax,aabbMin2,aabbMax2) &&
-                    TPE_bodiesResolveCollision(body,world->bodies + j,
-                                               world->environmentFunction))
-                {
-                    TPE_bodyActivate(body);
-                    body->deactivateCount = TPE_LIGHT_DEACTIVATION;
+            if (!(body->flags & TPE_BODY_FLAG_SIMPLE_CONN))
+                TPE_bodyCancelOutVelocities(body,hard);
+        }
+    }
 
-                    TPE_bodyActivate(world->bodies + j);
-                    world->bodies[j].deactivateCount = TPE_LIGHT_DEACTIVATION;
-                }
-            }
+    uint32_t c = _TPE_candidateStart[i], candidatesEnd = _TPE_candidateStart[i + 1];
+
+    if (_TPE_escapedCount == 0)
+    {
+        for (; c < candidatesEnd; ++c)
+            if (!_TPE_bodyPairStep(world,i,_TPE_candidates[c],aabbMin,aabbMax,inIslands))
+                return 0;
+    }
+    else // pairs with an escaped body are tested whether candidates or not
+        for (uint16_t j = 0; j < world->bodyCount; ++j)
+        {
+            uint8_t candidate = c < candidatesEnd && _TPE_candidates[c] == j;
+
+            c += candidate;
+
+            if ((candidate || _TPE_escaped[i] || _TPE_escaped[j]) &&
+                !_TPE_bodyPairStep(world,i,j,aabbMin,aabbMax,inIslands))
+                return 0;
         }
 
-        if(collided && not body->previouslyCollided && body->bodyCollisionCallback) {
-            TPE_Vec3 verticalSpeed = TPE_ARRAY_TO_VEC3(body->joints->velocity);
+    TPE_bodyGetAABB(body,&_TPE_aabbMin[i],&_TPE_aabbMax[i]);
+
+    if (!_TPE_checkGrownBounds(i,_TPE_aabbMin[i],_TPE_aabbMax[i],inIslands))
+        return 0;
+
+    if(collided && not body->previouslyCollided && body->bodyCollisionCallback) {
+        TPE_Vec3 verticalSpeed = TPE_ARRAY_TO_VEC3(body->joints->velocity);
+
+        if (inIslands)
+        {
+            _TPE_callbackPending[i] = 1;
+            _TPE_callbackSpeed[i] = verticalSpeed;
+        }
+        else
             body->bodyCollisionCallback(verticalSpeed);
-            body->previouslyCollided = true;
+
+        body->previouslyCollided = true;
+    }
+    else if(not collided)
+        body->previouslyCollided = false;
+
+    if (!(body->flags & TPE_BODY_FLAG_ALWAYS_ACTIVE))
+    {
+        if (body->deactivateCount >= TPE_DEACTIVATE_AFTER)
+        {
+            TPE_bodyStop(body);
+            body->deactivateCount = 0;
+            body->flags |= TPE_BODY_FLAG_DEACTIVATED;
+        }
+        else if (TPE_bodyGetAverageSpeed(body) <= TPE_LOW_SPEED)
+            body->deactivateCount++;
+        else
+            body->deactivateCount = 0;
+    }
+
+    return 1;
+}
+
+void TPE_worldStep(TPE_World *world)
+{
+    _TPE_collisionCallback = world->collisionCallback;
+
+    _TPE_broadphase(world);
+
+    for (uint16_t i = 0; i < world->bodyCount; ++i)
+        _TPE_bodyStep(world,i,0);
+}
+
+uint16_t _TPE_islandFind(uint16_t body)
+{
+    while (_TPE_islandParent[body] != body)
+    {
+        _TPE_islandParent[body] = _TPE_islandParent[_TPE_islandParent[body]];
+        body = _TPE_islandParent[body];
+    }
+
+    return body;
+}
+
+uint16_t TPE_worldStepBegin(TPE_World *world)
+{
+    uint16_t count = world->bodyCount;
+
+    _TPE_broadphase(world);
+
+    _TPE_callbackPending.assign(count,0);
+    _TPE_callbackSpeed.resize(count);
+    _TPE_islandsAbandoned.store(0,std::memory_order_relaxed);
+
+    _TPE_savedBodies.resize(count);
+    _TPE_savedJoints.clear();
+
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        const TPE_Body *body = world->bodies + i;
+
+        _TPE_savedBodies[i] = {body->flags,body->deactivateCount,body->previouslyCollided};
+        _TPE_savedJoints.insert(_TPE_savedJoints.end(),body->joints,body->joints + body->jointCount);
+    }
+
+    /* Bodies that aren't broadphase candidates of each other are never tested
+       against each other as long as they stay in their grown bounds, so unions
+       of the candidate pairs (keeping the lowest index as the root) give
+       islands that can be stepped independently. A body leaving its bounds
+       abandons all of them (see _TPE_checkGrownBounds). */
+
+    _TPE_islandParent.resize(count);
+
+    for (uint16_t i = 0; i < count; ++i)
+        _TPE_islandParent[i] = i;
+
+    for (uint32_t pair : _TPE_pairs)
+    {
+        uint16_t a = _TPE_islandFind(pair >> 16), b = _TPE_islandFind(pair & 0xffff);
+
+        if (a < b)
+            _TPE_islandParent[b] = a;
+        else if (b < a)
+            _TPE_islandParent[a] = b;
+    }
+
+    // counting sort by root, bodies stay in index order within an island
+
+    _TPE_islandStart.assign(count + 1,0);
+
+    for (uint16_t i = 0; i < count; ++i)
+        _TPE_islandStart[_TPE_islandFind(i) + 1]++;
+
+    for (uint16_t i = 0; i < count; ++i)
+        _TPE_islandStart[i + 1] += _TPE_islandStart[i];
+
+    _TPE_islandBodies.resize(count);
+    _TPE_islandFill.assign(_TPE_islandStart.begin(),_TPE_islandStart.end() - 1);
+
+    for (uint16_t i = 0; i < count; ++i)
+        _TPE_islandBodies[_TPE_islandFill[_TPE_islandFind(i)]++] = i;
+
+    // the sorted bodies are cut into groups of whole islands
+
+    _TPE_groupStart.clear();
+    _TPE_groupStart.push_back(0);
+
+    uint32_t groupSize = 0;
+
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        uint32_t islandSize = _TPE_islandStart[i + 1] - _TPE_islandStart[i];
+
+        if (islandSize == 0)
+            continue;
+
+        groupSize += islandSize;
+
+        if (groupSize >= TPE_ISLAND_GROUP_SIZE)
+        {
+            _TPE_groupStart.push_back(_TPE_islandStart[i + 1]);
+            groupSize = 0;
         }
-        else if(not collided)
-            body->previouslyCollided = false;
+    }
+
+    if (groupSize > 0)
+        _TPE_groupStart.push_back(count);
+
+    return _TPE_groupStart.size() - 1;
+}
+
+void TPE_worldStepGroup(TPE_World *world, uint16_t group)
+{
+    _TPE_collisionCallback = world->collisionCallback;
+
+    for (uint32_t b = _TPE_groupStart[group]; b < _TPE_groupStart[group + 1]; ++b)
+        if (_TPE_islandsAbandoned.load(std::memory_order_relaxed) ||
+            !_TPE_bodyStep(world,_TPE_islandBodies[b],1))
+            return;
+}
+
+void TPE_worldStepEnd(TPE_World *world)
+{
+    if (_TPE_islandsAbandoned.load(std::memory_order_relaxed))
+    {
+        // a body left its grown bounds, redo the step from where it started
+
+        const TPE_Joint *joint = _TPE_savedJoints.data();
 
-        if (!(body->flags & TPE_BODY_FLAG_ALWAYS_ACTIVE))
+        for (uint16_t i = 0; i < world->bodyCount; ++i)
         {
-            if (body->deactivateCount >= TPE_DEACTIVATE_AFTER)
-            {
-                TPE_bodyStop(body);
-                body->deactivateCount = 0;
-                body->flags |= TPE_BODY_FLAG_DEACTIVATED;
-            }
-            else if (TPE_bodyGetAverageSpeed(body) <= TPE_LOW_SPEED)
-                body->deactivateCount++;
-            else
-                body->deactivateCount = 0;
+            TPE_Body *body = world->bodies + i;
+
+            body->flags = _TPE_savedBodies[i].flags;
+            body->deactivateCount = _TPE_savedBodies[i].deactivateCount;
+            body->previouslyCollided = _TPE_savedBodies[i].previouslyCollided;
+
+            std::copy(joint,joint + body->jointCount,body->joints);
+            joint += body->jointCount;
         }
+
+        TPE_worldStep(world);
+        return;
     }
+
+    for (uint16_t i = 0; i < world->bodyCount; ++i)
+        if (_TPE_callbackPending[i])
+            world->bodies[i].bodyCollisionCallback(_TPE_callbackSpeed[i]);
 }
 
 void TPE_bodyActivate(TPE_Body *body)
@@ -127,6 +127,12 @@ inline constexpr std::size_t TPE_INFINITY = std::numeric_limits<TPE_Unit>::max()
   #define TPE_DEACTIVATE_AFTER 128
 #endif
 
+#ifndef TPE_ISLAND_GROUP_SIZE
+/** How many bodies of whole islands TPE_worldStepBegin puts in one group at
+  least, so that lone bodies aren't handed out one by one. */
+  #define TPE_ISLAND_GROUP_SIZE 32
+#endif
+
 #ifndef TPE_LIGHT_DEACTIVATION
 /** When a body is activated by a collision, its deactivation counter will be
   set to this value, i.e. after a collision the body will be prone to deactivate
@@ -475,6 +481,26 @@ TPE_Vec3 TPE_castBodyRay(TPE_Vec3 rayPos, TPE_Vec3 rayDir, int16_t excludeBody,
   1/30th of a second. */
 void TPE_worldStep(TPE_World *world);
 
+/** Same as TPE_worldStep, split into islands: sets of bodies that can't touch
+  bodies of other islands during the step as long as they stay within the
+  broadphase margin. Returns the number of groups (runs of whole islands, of
+  about TPE_ISLAND_GROUP_SIZE bodies) to then pass to TPE_worldStepGroup, after
+  which TPE_worldStepEnd has to be called. */
+uint16_t TPE_worldStepBegin(TPE_World *world);
+
+/** Steps one group of islands. Different groups can be stepped at the same
+  time from different threads (as long as the environment and collision
+  callback functions are thread safe), with the same results as TPE_worldStep
+  no matter the order. If a body leaves the margin, the groups stop early and
+  the step is redone serially by TPE_worldStepEnd. */
+void TPE_worldStepGroup(TPE_World *world, uint16_t group);
+
+/** Finishes a step started with TPE_worldStepBegin. Body collision callbacks
+  are called here, in body order, instead of during the step. If the islands
+  were abandoned, the bodies are reset and stepped with TPE_worldStep here,
+  so the collision callback may see collisions of the abandoned attempt. */
+void TPE_worldStepEnd(TPE_World *world);
+
 void TPE_worldDeactivateAll(TPE_World *world);
 void TPE_worldActivateAll(TPE_World *world);
 